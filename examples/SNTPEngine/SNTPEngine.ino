@@ -0,0 +1,75 @@
+/**
+ * @file SNTPEngine.ino
+ * @brief Measures the I/O-free protocol engine on its own.
+ * 
+ * BATCH requests are built into one buffer, answered by a synthetic server with a known offset
+ * and processed as a batch, the way a transport collecting several replies at once would do it.
+ * Prints the samples per second and checks that every offset comes out right.
+ * 
+ * No network is needed, so this runs on any board.
+ */
+#include <NTPEngine.h>
+
+static constexpr size_t BATCH = 64;
+static constexpr unsigned int ROUNDS = 200;
+static constexpr int64_t OFFSET_US = 123456;     ///< Server clock ahead of the client.
+static constexpr unsigned long ONE_WAY_US = 5000; ///< Delay of each direction.
+
+static uint8_t requests[BATCH][NTPEngine::PACKET_SIZE];
+static uint8_t replies[BATCH][NTPEngine::PACKET_SIZE];
+static NTPEngine::ntp_request pending[BATCH];
+static NTPTimestamp t4s[BATCH];
+
+// Answers a request like a server whose clock is OFFSET_US ahead would.
+static void answer(const uint8_t *request, uint8_t *reply, NTPTimestamp t1)
+{
+    memcpy(reply, request, NTPEngine::PACKET_SIZE);
+    NTPTimestamp t2 = t1 + NTPDuration::fromMicros(ONE_WAY_US + OFFSET_US);
+    NTPTimestamp t3 = t2 + NTPDuration::fromMicros(100);
+    uint64_t org, rec = t2.encode(), xmt = t3.encode();
+    memcpy(&org, request + NTPEngine::OFFSET_XMT, sizeof(org));
+    reply[NTPEngine::OFFSET_LI_VN_MODE] = NTPEngine::NTP_VERSION_4 | NTPEngine::MODE_SERVER;
+    reply[NTPEngine::OFFSET_STRATUM] = 2;
+    memcpy(reply + NTPEngine::OFFSET_ORG, &org, sizeof(org));
+    memcpy(reply + NTPEngine::OFFSET_REC, &rec, sizeof(rec));
+    memcpy(reply + NTPEngine::OFFSET_XMT, &xmt, sizeof(xmt));
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    NTPTimestamp t1 = NTPTimestamp::fromUnix(std::chrono::seconds(1637244065));
+    for (size_t i = 0; i < BATCH; i++)
+    {
+        // Every request gets its own T1, so the replies can be told apart.
+        NTPTimestamp t1_i = t1 + NTPDuration::fromMicros(i);
+        NTPEngine::buildRequest(t1_i, requests[i], sizeof(requests[i]), &pending[i]);
+        answer(requests[i], replies[i], t1_i);
+        t4s[i] = t1_i + NTPDuration::fromMicros(2 * ONE_WAY_US + 100);
+    }
+
+    bool passed = true;
+    unsigned long start = micros();
+    for (unsigned int round = 0; round < ROUNDS; round++)
+    {
+        for (size_t i = 0; i < BATCH; i++)
+        {
+            NTPEngine::ntp_result result;
+            passed &= NTPEngine::processReply(pending[i], replies[i], sizeof(replies[i]), t4s[i], &result);
+            passed &= result.offset.toMicros() == OFFSET_US;
+        }
+    }
+    unsigned long elapsed = micros() - start;
+
+    Serial.print(passed ? F("PASS ") : F("FAIL "));
+    Serial.print((unsigned long)BATCH * ROUNDS);
+    Serial.print(F(" samples in "));
+    Serial.print(elapsed);
+    Serial.print(F(" us, "));
+    Serial.print(elapsed ? (double)BATCH * ROUNDS * 1e6 / elapsed : 0.0, 0);
+    Serial.println(F(" samples/s"));
+}
+
+void loop()
+{
+}
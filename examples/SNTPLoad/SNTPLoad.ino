@@ -0,0 +1,216 @@
+/**
+ * @file SNTPLoad.ino
+ * @brief Emulates a fleet of SNTP clients to size a local NTP server.
+ * 
+ * CLIENTS clients are emulated, spread over SOCKETS local UDP ports.  Each one polls the server
+ * with intervals drawn from DISTRIBUTION around POLL_MS and starts with a burst of BURST requests
+ * like iburst does.  Requests are encoded with the library's ntp_packet.  The Transmit Timestamp
+ * carries client number and sequence number, so every reply can be matched by its Originate
+ * Timestamp.  Round-trip latencies go into one histogram per socket, merged for the report, the
+ * way per-task histograms are combined on a multi core board.  Replies missing after TIMEOUT_MS are
+ * counted as lost.  A report is printed every REPORT_MS.
+ * 
+ * Only use this against servers you operate yourself.
+ */
+#if defined(ESP32)
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+#include <Histogram.h>
+#include <MessageTransport.h>
+#include <WiFiUdp.h>
+#include <cmath>
+
+// Fill in your WiFi credentials and the server under test.
+static const char WIFI_SSID[] = "your-ssid";
+static const char WIFI_PASSWORD[] = "your-password";
+static const IPAddress SERVER(192, 168, 1, 10);
+
+enum poll_distribution
+{
+    POLL_FIXED,       ///< every client polls exactly every POLL_MS
+    POLL_UNIFORM,     ///< uniformly distributed between POLL_MS / 2 and 3 * POLL_MS / 2
+    POLL_EXPONENTIAL, ///< exponentially distributed with mean POLL_MS (Poisson arrivals)
+};
+
+static constexpr size_t CLIENTS = 64;
+static constexpr size_t SOCKETS = 4;                 ///< Source port spread.
+static constexpr uint16_t FIRST_LOCAL_PORT = 40123U; ///< Sockets use FIRST_LOCAL_PORT ... + SOCKETS - 1.
+static constexpr unsigned long POLL_MS = 1000UL;
+static constexpr poll_distribution DISTRIBUTION = POLL_EXPONENTIAL;
+static constexpr unsigned int BURST = 4;             ///< Requests of the initial burst.
+static constexpr unsigned long BURST_SPACING_MS = 50UL;
+static constexpr unsigned long TIMEOUT_MS = 1000UL;
+static constexpr unsigned long REPORT_MS = 10000UL;
+static constexpr uint16_t NTP_SERVER_PORT = 123U;
+
+struct emulated_client
+{
+    unsigned long next_poll_ms; ///< millis() of the next request
+    unsigned long sent_us;      ///< micros() of the pending request
+    uint32_t seq;               ///< sequence number of the pending request
+    unsigned int burst_left;    ///< requests left of the current burst
+    bool pending;               ///< a reply is outstanding
+};
+
+struct load_stats
+{
+    uint32_t sent;
+    uint32_t received;
+    uint32_t lost;
+    uint32_t unmatched;
+};
+
+static WiFiUDP sockets[SOCKETS];
+static emulated_client clients[CLIENTS];
+static load_stats stats;
+static NTPHistogram latencies_us[SOCKETS];
+static unsigned long report_ms;
+
+static unsigned long poll_interval()
+{
+    switch (DISTRIBUTION)
+    {
+    case POLL_UNIFORM:
+        return random(POLL_MS / 2, POLL_MS + POLL_MS / 2 + 1);
+    case POLL_EXPONENTIAL:
+        return (unsigned long)(-log(random(1, 1000001) / 1e6) * POLL_MS);
+    case POLL_FIXED:
+    default:
+        return POLL_MS;
+    }
+}
+
+static void send_request(size_t id)
+{
+    emulated_client &client = clients[id];
+    NTPMessageTransport::ntp_packet request = {};
+    request.li_vn_mode = 0b00'100'011; // No leap warning, version 4, client mode
+    client.seq++;
+    request.xmt = NTPTimestamp((uint32_t)id, client.seq).encode();
+
+    WiFiUDP &socket = sockets[id % SOCKETS];
+    socket.beginPacket(SERVER, NTP_SERVER_PORT);
+    socket.write((const uint8_t *)&request, sizeof(request));
+    socket.endPacket();
+    client.sent_us = micros();
+    client.pending = true;
+    stats.sent++;
+}
+
+static void receive_replies()
+{
+    for (size_t s = 0; s < SOCKETS; s++)
+    {
+        while (sockets[s].parsePacket() >= (int)sizeof(NTPMessageTransport::ntp_packet))
+        {
+            unsigned long now_us = micros();
+            NTPMessageTransport::ntp_packet reply;
+            sockets[s].read((char *)&reply, sizeof(reply));
+            sockets[s].flush();
+            NTPTimestamp org = NTPTimestamp::decode(reply.org);
+            uint32_t id = org.seconds();
+            uint32_t seq = org.fraction();
+            if (id >= CLIENTS || !clients[id].pending || clients[id].seq != seq)
+            {
+                // Late reply of a request already counted as lost, or garbage.
+                stats.unmatched++;
+                continue;
+            }
+            clients[id].pending = false;
+            stats.received++;
+            latencies_us[s].record(now_us - clients[id].sent_us);
+        }
+    }
+}
+
+static void report()
+{
+    static NTPHistogram latency_us;
+    latency_us.reset();
+    for (NTPHistogram &socket_latency_us : latencies_us)
+    {
+        latency_us.merge(socket_latency_us);
+        socket_latency_us.reset();
+    }
+    Serial.print(F("sent "));
+    Serial.print(stats.sent);
+    Serial.print(F(", received "));
+    Serial.print(stats.received);
+    Serial.print(F(", lost "));
+    Serial.print(stats.lost);
+    Serial.print(F(", unmatched "));
+    Serial.print(stats.unmatched);
+    Serial.print(F(", rate "));
+    Serial.print(stats.sent * 1000.0 / REPORT_MS);
+    Serial.print(F("/s, latency p50 "));
+    Serial.print(latency_us.percentile(0.50));
+    Serial.print(F(" us, p90 "));
+    Serial.print(latency_us.percentile(0.90));
+    Serial.print(F(" us, p99 "));
+    Serial.print(latency_us.percentile(0.99));
+    Serial.print(F(" us, p99.9 "));
+    Serial.print(latency_us.percentile(0.999));
+    Serial.print(F(" us, max "));
+    Serial.print(latency_us.max());
+    Serial.println(F(" us"));
+    stats = load_stats();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    while (WiFi.status() != WL_CONNECTED)
+    {
+        delay(500);
+    }
+    for (size_t s = 0; s < SOCKETS; s++)
+    {
+        sockets[s].begin(FIRST_LOCAL_PORT + s);
+    }
+    unsigned long now = millis();
+    for (size_t id = 0; id < CLIENTS; id++)
+    {
+        // Spread the start of the clients over one poll interval.
+        clients[id].next_poll_ms = now + random(POLL_MS);
+        clients[id].burst_left = BURST;
+    }
+    report_ms = now + REPORT_MS;
+}
+
+void loop()
+{
+    receive_replies();
+    unsigned long now = millis();
+    for (size_t id = 0; id < CLIENTS; id++)
+    {
+        emulated_client &client = clients[id];
+        if (client.pending && (micros() - client.sent_us) / 1000UL >= TIMEOUT_MS)
+        {
+            client.pending = false;
+            stats.lost++;
+        }
+        if ((long)(now - client.next_poll_ms) < 0 || client.pending)
+            continue;
+        send_request(id);
+        if (client.burst_left > 1)
+        {
+            client.burst_left--;
+            client.next_poll_ms = now + BURST_SPACING_MS;
+        }
+        else
+        {
+            client.burst_left = 0;
+            client.next_poll_ms = now + poll_interval();
+        }
+    }
+    if ((long)(now - report_ms) >= 0)
+    {
+        report();
+        report_ms = now + REPORT_MS;
+    }
+    yield();
+}
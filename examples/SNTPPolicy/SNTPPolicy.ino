@@ -0,0 +1,116 @@
+/**
+ * @file SNTPPolicy.ino
+ * @brief Compares NTPClient with clients put together from policies.
+ * 
+ * The same made up exchanges are replayed through NTPClient and the policies of NTPTinyClient
+ * and NTPDisciplinedBasicClient.  NTPClient takes them from NTPReplayTransport, the policy
+ * clients from NTPStaticReplayTransport, which has no virtual functions just like the
+ * NTPUdpTransport of the aliases.  For each it prints the RAM taken by the object (sizeof),
+ * the microseconds per sample and whether all offsets came out right.
+ * 
+ * The flash taken is not known to the sketch itself.  Build it twice and compare the sizes the
+ * IDE reports, or the sketch size printed last on ESP boards: once as it is and once with
+ * USE_NTPCLIENT set to 0, which leaves NTPClient out of the image.  The difference is the flash
+ * NTPClient adds on top of the policy clients.
+ * 
+ * No network is needed, so this runs on any board.
+ */
+#include <BasicClient.h>
+#include <ReplayTransport.h>
+#include <cmath>
+
+#ifndef USE_NTPCLIENT
+#define USE_NTPCLIENT 1
+#endif
+
+#if USE_NTPCLIENT
+#include <ntpclient.h>
+#endif
+
+static constexpr size_t SAMPLES = 64;
+static constexpr unsigned int ROUNDS = 16;
+// A stratum 2 server 250 ms ahead behind a symmetric path, q.v. SNTPReplay.
+static constexpr NTPStaticReplayTransport::ntp_scenario SERVER = {0.250, 0.010, 0.010, 0.0, 0, 2, false};
+
+static NTPStaticReplayTransport::ntp_record records[SAMPLES];
+
+// The policies of NTPTinyClient and NTPDisciplinedBasicClient on the replay instead of NTPUdpTransport.
+using ReplayTinyClient = NTPBasicClient<NTPStaticReplayTransport, NTPInterimClock, NTPNoFilter, NTPNullLogger>;
+using ReplayDisciplinedClient =
+    NTPBasicClient<NTPStaticReplayTransport, NTPDisciplinedClock, NTPDistanceFilter, NTPSerialLogger>;
+
+static void report(const __FlashStringHelper *name, size_t size, bool passed, unsigned long elapsed)
+{
+    Serial.print(passed ? F("PASS ") : F("FAIL "));
+    Serial.print(name);
+    Serial.print(F(": "));
+    Serial.print(size);
+    Serial.print(F(" bytes RAM, "));
+    Serial.print((double)elapsed / (SAMPLES * ROUNDS), 2);
+    Serial.println(F(" us per sample"));
+}
+
+// Runs a policy based client over all records ROUNDS times.
+template <class Client>
+static void run_basic(const __FlashStringHelper *name)
+{
+    static NTPStaticReplayTransport transport(records, SAMPLES);
+    static Client client(transport);
+
+    bool passed = true;
+    unsigned long start = micros();
+    for (unsigned int round = 0; round < ROUNDS; round++)
+    {
+        transport.rewind();
+        for (size_t i = 0; i < SAMPLES; i++)
+        {
+            NTPEngine::ntp_result result;
+            passed &= client.query(&result);
+            passed &= fabs(result.offset.toSeconds() - SERVER.offset_s) < 1e-6;
+        }
+    }
+    report(name, sizeof(client), passed, micros() - start);
+}
+
+#if USE_NTPCLIENT
+static void run_ntpclient()
+{
+    static NTPReplayTransport transport(records, SAMPLES);
+    static NTPClient client(transport);
+    client.begin("replay");
+
+    bool passed = true;
+    unsigned long start = micros();
+    for (unsigned int round = 0; round < ROUNDS; round++)
+    {
+        transport.rewind();
+        for (size_t i = 0; i < SAMPLES; i++)
+        {
+            NTPClient::ntp_sample sample;
+            passed &= client.query(&sample);
+            passed &= fabs(sample.offset - SERVER.offset_s) < 1e-6;
+        }
+    }
+    report(F("NTPClient"), sizeof(client), passed, micros() - start);
+}
+#endif
+
+void setup()
+{
+    Serial.begin(115200);
+    NTPStaticReplayTransport::synthesize(SERVER, records, SAMPLES);
+#if USE_NTPCLIENT
+    run_ntpclient();
+#endif
+    run_basic<ReplayTinyClient>(F("NTPTinyClient"));
+    run_basic<ReplayDisciplinedClient>(F("NTPDisciplinedBasicClient"));
+#if defined(ESP32) || defined(ESP8266)
+    Serial.print(F("Sketch size: "));
+    Serial.print(ESP.getSketchSize());
+    Serial.println(F(" bytes flash"));
+#endif
+}
+
+void loop()
+{
+}
@@ -0,0 +1,138 @@
+/**
+ * @file SNTPQuery.ino
+ * @brief Queries NTP servers like "sntp" or "ntpdate -q" do and prints what they tell.
+ * 
+ * For every server in SERVERS a burst of COUNT queries is made, INTERVAL_MS apart.  Each answer
+ * is printed as offset, round-trip delay, stratum and root distance, either as readable text or
+ * as one JSON object per line (OUTPUT_JSON) for feeding the results into other tools.
+ * 
+ * The local clock is not touched.
+ */
+#if defined(ESP32)
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+#include <ntpclient.h>
+
+// Fill in your WiFi credentials.
+static const char WIFI_SSID[] = "your-ssid";
+static const char WIFI_PASSWORD[] = "your-password";
+
+// Servers to be queried one after another.
+static const char *const SERVERS[] = {"europe.pool.ntp.org", "time.google.com", "ptbtime1.ptb.de"};
+static constexpr size_t SERVER_COUNT = sizeof(SERVERS) / sizeof(SERVERS[0]);
+static constexpr unsigned int COUNT = 4;          ///< Queries per server and burst.
+static constexpr unsigned long INTERVAL_MS = 2000; ///< Pause between two queries.  Be nice to public servers.
+static constexpr bool OUTPUT_JSON = false;        ///< One JSON object per line instead of text.
+
+NTPClient ntp;
+
+// Root distance as in RFC 5905, 11.2 Clock Select Algorithm, without the local dispersion terms.
+static double root_distance(const NTPClient::ntp_sample &sample)
+{
+    return (sample.rootdelay + sample.delay) / 2.0 + sample.rootdisp;
+}
+
+static void print_text(const char *server, unsigned int seq, const NTPClient::ntp_sample &sample)
+{
+    Serial.print(server);
+    Serial.print(F(" ("));
+    Serial.print(IPAddress(sample.server).toString());
+    Serial.print(F(") #"));
+    Serial.print(seq);
+    Serial.print(F(": offset "));
+    Serial.print(sample.offset, 6);
+    Serial.print(F(" s, delay "));
+    Serial.print(sample.delay, 6);
+    Serial.print(F(" s, stratum "));
+    Serial.print(sample.stratum);
+    Serial.print(F(", root distance "));
+    Serial.print(root_distance(sample), 6);
+    Serial.println(F(" s"));
+}
+
+static void print_json(const char *server, unsigned int seq, const NTPClient::ntp_sample &sample)
+{
+    Serial.print(F("{\"server\":\""));
+    Serial.print(server);
+    Serial.print(F("\",\"address\":\""));
+    Serial.print(IPAddress(sample.server).toString());
+    Serial.print(F("\",\"seq\":"));
+    Serial.print(seq);
+    Serial.print(F(",\"offset\":"));
+    Serial.print(sample.offset, 6);
+    Serial.print(F(",\"delay\":"));
+    Serial.print(sample.delay, 6);
+    Serial.print(F(",\"stratum\":"));
+    Serial.print(sample.stratum);
+    Serial.print(F(",\"root_distance\":"));
+    Serial.print(root_distance(sample), 6);
+    Serial.println(F("}"));
+}
+
+static void print_error(const char *server, unsigned int seq, const NTPStatus &status)
+{
+    char error[NTPStatus::FORMAT_SIZE];
+    status.format(error, sizeof(error));
+    if (OUTPUT_JSON)
+    {
+        Serial.print(F("{\"server\":\""));
+        Serial.print(server);
+        Serial.print(F("\",\"seq\":"));
+        Serial.print(seq);
+        Serial.print(F(",\"error\":\""));
+        Serial.print(error);
+        Serial.println(F("\"}"));
+    }
+    else
+    {
+        Serial.print(server);
+        Serial.print(F(" #"));
+        Serial.print(seq);
+        Serial.print(F(": "));
+        Serial.println(error);
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    while (WiFi.status() != WL_CONNECTED)
+    {
+        delay(500);
+    }
+    ntp.begin(nullptr);
+}
+
+void loop()
+{
+    for (size_t i = 0; i < SERVER_COUNT; i++)
+    {
+        ntp.setServerName(SERVERS[i]);
+        for (unsigned int seq = 1; seq <= COUNT; seq++)
+        {
+            NTPClient::ntp_sample sample;
+            NTPStatus status = ntp.tryQuery(&sample);
+            if (status)
+            {
+                if (OUTPUT_JSON)
+                    print_json(SERVERS[i], seq, sample);
+                else
+                    print_text(SERVERS[i], seq, sample);
+            }
+            else
+            {
+                print_error(SERVERS[i], seq, status);
+            }
+            delay(INTERVAL_MS);
+        }
+    }
+    // One round is enough.  Reset the board for another one.
+    for (;;)
+    {
+        delay(1000);
+    }
+}
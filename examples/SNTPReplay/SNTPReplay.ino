@@ -0,0 +1,221 @@
+/**
+ * @file SNTPReplay.ino
+ * @brief Feeds recorded exchanges through NTPClient and checks the outcome.
+ * 
+ * Every scenario of the corpus below is turned into recorded exchanges with known true offset
+ * and known one-way delays by NTPStaticReplayTransport::synthesize(), replayed through
+ * NTPReplayTransport and NTPClient::query(), and checked against what must come out:
+ * - successful samples must not be off by more than half of their round-trip delay (the error
+ *   bound of the On-Wire protocol for any path asymmetry) and by no more than MAX_ERROR_S on
+ *   symmetric paths,
+ * - rejected replies and samples beyond the root distance limit must fail with the expected
+ *   errno,
+ * - processing a sample must not take more than MAX_MICROS_PER_SAMPLE.
+ * 
+ * Then the records are written as pcapng by NTPPcapWriter and read back by NTPPcapReader, which
+ * must give the same records.  So captures taken in the field can be replayed the same way.
+ * 
+ * Last a NTPTimeBase goes into holdover after a time correction.  Its steady timeline must have
+ * worked the correction off and run at the frequency correction alone from then on.
+ * 
+ * No network is needed.
+ */
+#include <PcapReader.h>
+#include <PcapWriter.h>
+#include <ReplayTransport.h>
+#include <cerrno>
+#include <cmath>
+#include <ntpclient.h>
+
+static constexpr size_t SAMPLES = 16;
+static constexpr double MAX_ERROR_S = 10e-6;
+static constexpr unsigned long MAX_MICROS_PER_SAMPLE = 2000UL;
+
+struct replay_case
+{
+    const char *name;
+    NTPReplayTransport::ntp_scenario server;
+    int expected_errno; ///< 0 if the samples must be accepted
+};
+
+static const replay_case CORPUS[] = {
+    {"symmetric", {0.125, 0.010, 0.010, 0.0, 0, 2, false}, 0},
+    {"congestion", {-0.300, 0.005, 0.005, 0.080, 0, 2, false}, 0},
+    {"asymmetric path", {0.050, 0.002, 0.040, 0.0, 0, 2, false}, 0},
+    {"leap second warning", {1.500, 0.010, 0.010, 0.0, 1, 1, false}, 0},
+    {"unsynchronized server", {0.0, 0.010, 0.010, 0.0, 3, 2, false}, ENODATA},
+    {"kiss-o'-death RATE", {0.0, 0.010, 0.010, 0.0, 0, 0, false}, EAGAIN},
+    {"reserved stratum", {0.0, 0.010, 0.010, 0.0, 0, 16, false}, EPFNOSUPPORT},
+    {"stale reply", {0.0, 0.010, 0.010, 0.0, 0, 2, true}, EBADMSG},
+    {"distant server", {0.0, 2.0, 2.0, 0.0, 0, 2, false}, ERANGE},
+};
+
+static NTPReplayTransport::ntp_record records[SAMPLES];
+
+static bool run_case(const replay_case &c)
+{
+    NTPStaticReplayTransport::synthesize(c.server, records, SAMPLES);
+    NTPReplayTransport transport(records, SAMPLES);
+    NTPClient client(transport);
+    client.begin("replay");
+
+    bool passed = true;
+    double worst_error = 0.0;
+    unsigned long micros_total = 0;
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        NTPClient::ntp_sample sample;
+        errno = 0;
+        unsigned long micros_start = micros();
+        bool ok = client.query(&sample);
+        micros_total += micros() - micros_start;
+        if (c.expected_errno != 0)
+        {
+            passed &= !ok && errno == c.expected_errno;
+            continue;
+        }
+        if (!ok)
+        {
+            passed = false;
+            continue;
+        }
+        double error = fabs(sample.offset - c.server.offset_s);
+        worst_error = fmax(worst_error, error);
+        passed &= error <= sample.delay / 2.0 + MAX_ERROR_S;
+        passed &= (c.server.out_s != c.server.back_s) || (c.server.queue_s != 0.0) || error <= MAX_ERROR_S;
+        passed &= sample.leap == c.server.leap;
+    }
+    unsigned long micros_per_sample = micros_total / SAMPLES;
+    passed &= micros_per_sample <= MAX_MICROS_PER_SAMPLE;
+
+    // Every query has been counted once, as sample or as failure.
+    NTPClientMetrics::metrics_snapshot metrics;
+    client.metrics().snapshot(&metrics);
+    uint32_t failures = 0;
+    for (uint32_t count : metrics.failures)
+        failures += count;
+    passed &= metrics.queries == SAMPLES;
+    passed &= metrics.samples + failures == SAMPLES;
+    passed &= (c.expected_errno != EAGAIN) || (metrics.kod[NTPClientMetrics::KOD_RATE] == SAMPLES);
+    passed &= (c.expected_errno != ERANGE) || (metrics.failures[NTPClientMetrics::FAIL_FILTERED] == SAMPLES);
+
+    Serial.print(passed ? F("PASS ") : F("FAIL "));
+    Serial.print(c.name);
+    Serial.print(F(": worst offset error "));
+    Serial.print(worst_error * 1e3, 3);
+    Serial.print(F(" ms, "));
+    Serial.print(micros_per_sample);
+    Serial.println(F(" us per sample"));
+    return passed;
+}
+
+// Keeps what is written to it for reading it back.
+class MemoryStream : public Stream
+{
+public:
+    size_t write(uint8_t b) override
+    {
+        if (_size >= sizeof(_data))
+            return 0;
+        _data[_size++] = b;
+        return 1;
+    }
+    int available() override { return (int)(_size - _position); }
+    int read() override { return _position < _size ? _data[_position++] : -1; }
+    int peek() override { return _position < _size ? _data[_position] : -1; }
+
+private:
+    uint8_t _data[64 + SAMPLES * 2 * 112]; // Headers and two packet blocks per exchange
+    size_t _size = 0;
+    size_t _position = 0;
+};
+
+static bool run_pcap_round_trip()
+{
+    static MemoryStream capture;
+    NTPStaticReplayTransport::synthesize(CORPUS[0].server, records, SAMPLES);
+    NTPPcapWriter writer(capture);
+    bool passed = writer.begin();
+    for (const NTPReplayTransport::ntp_record &r : records)
+    {
+        NTPMessageTransport::ntp_packet request = {};
+        request.xmt = r.t1;
+        NTPTimestamp t4 = NTPTimestamp::decode(r.t1) + NTPDuration::fromMicros(r.roundtrip_us);
+        writer.capture(request, r.reply, IPAddress(192, 0, 2, 1), 8123, t4.encode());
+    }
+
+    NTPPcapReader reader(capture);
+    passed &= reader.begin();
+    size_t count = 0;
+    NTPReplayTransport::ntp_record read_back;
+    while (reader.next(&read_back) && (count < SAMPLES))
+    {
+        const NTPReplayTransport::ntp_record &r = records[count++];
+        passed &= read_back.t1 == r.t1;
+        passed &= memcmp(&read_back.reply, &r.reply, sizeof(r.reply)) == 0;
+        // Capture times are whole nanoseconds, so the round-trip may be off by one microsecond.
+        passed &= labs((long)(read_back.roundtrip_us - r.roundtrip_us)) <= 1;
+    }
+    passed &= (count == SAMPLES) && (errno == ENODATA);
+
+    Serial.print(passed ? F("PASS ") : F("FAIL "));
+    Serial.print(F("pcapng round trip: "));
+    Serial.print(count);
+    Serial.println(F(" records"));
+    return passed;
+}
+
+static bool run_steady_holdover()
+{
+    constexpr double DRIFT = 20e-6;       // The local counter runs slow by 20 ppm.
+    constexpr int64_t STEP_NS = 5000000;  // Time correction of the second sample
+    constexpr int64_t INTERVAL_US = 16000000;
+    NTPTimeBase time_base;
+    int64_t local_us = NTPTimeBase::localMicros();
+    NTPTimestamp t0 = NTPTimeBase::INTERIM_EPOCH;
+    time_base.update(t0, local_us);
+    int64_t steady0_ns = time_base.steadyAt(local_us);
+    time_base.update(t0 + NTPDuration::fromChrono(std::chrono::nanoseconds(
+                              INTERVAL_US * 1000 + (int64_t)(INTERVAL_US * 1000 * DRIFT) + STEP_NS)),
+                     local_us + INTERVAL_US);
+
+    // Holdover long after the slew has ended.  No more samples come.
+    int64_t x1_us = local_us + 10 * INTERVAL_US;
+    int64_t x2_us = local_us + 100 * INTERVAL_US;
+    int64_t steady_rate_ns = time_base.steadyAt(x2_us) - time_base.steadyAt(x1_us) - (x2_us - x1_us) * 1000;
+    int64_t freq_rate_ns = (x2_us - x1_us) * time_base.frequency() / 1000000;
+    // Synchronized time and steady timeline keep the distance they had at the first sample.
+    int64_t gap_ns = (time_base.at(x1_us) - t0).toChrono().count() - (time_base.steadyAt(x1_us) - steady0_ns);
+
+    bool passed = (llabs(steady_rate_ns - freq_rate_ns) <= 1) && (llabs(gap_ns) <= 1000);
+    Serial.print(passed ? F("PASS ") : F("FAIL "));
+    Serial.print(F("steady holdover: rate off by "));
+    Serial.print((long)(steady_rate_ns - freq_rate_ns));
+    Serial.print(F(" ns, gap "));
+    Serial.print((long)gap_ns);
+    Serial.println(F(" ns"));
+    return passed;
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    size_t failed = 0;
+    for (const replay_case &c : CORPUS)
+    {
+        if (!run_case(c))
+            failed++;
+    }
+    if (!run_pcap_round_trip())
+        failed++;
+    if (!run_steady_holdover())
+        failed++;
+    Serial.print(failed == 0 ? F("All scenarios passed") : F("Scenarios failed: "));
+    if (failed != 0)
+        Serial.print(failed);
+    Serial.println();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,67 @@
+/**
+ * @file SNTPStability.ino
+ * @brief Characterizes the oscillator of this board by its Allan deviation.
+ * 
+ * Queries the server every TAU0_MS for as long as it runs and prints the Allan and modified
+ * Allan deviation over tau every REPORT_EVERY samples, together with the poll interval that
+ * suits the oscillator and the network best.  Let it run for a day or more on every board model
+ * you use and note the suggested poll interval.
+ * 
+ * Failed queries leave gaps the analysis cannot bridge, so the phase is taken from the time
+ * base at the scheduled moment instead.  Few failures do no harm, many do.
+ */
+#if defined(ESP32)
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+#include <StabilityAnalyzer.h>
+#include <ntpclient.h>
+
+// Fill in your WiFi credentials.
+static const char WIFI_SSID[] = "your-ssid";
+static const char WIFI_PASSWORD[] = "your-password";
+
+static const char NTP_SERVER[] = "europe.pool.ntp.org";
+static constexpr unsigned long TAU0_MS = 16000UL;   ///< Sample interval, 2^4 s.  Be nice to public servers.
+static constexpr unsigned int REPORT_EVERY = 64;    ///< Samples between two reports.
+
+NTPClient ntp;
+NTPStabilityAnalyzer analyzer(TAU0_MS / 1e3);
+unsigned long next_ms = 0;
+
+void setup()
+{
+    Serial.begin(115200);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    while (WiFi.status() != WL_CONNECTED)
+        delay(500);
+    ntp.begin(NTP_SERVER);
+    ntp.syncMonitor().setPollInterval(TAU0_MS);
+    next_ms = millis();
+}
+
+void loop()
+{
+    if ((long)(millis() - next_ms) < 0)
+        return;
+    next_ms += TAU0_MS;
+
+    NTPClient::ntp_sample sample;
+    if (ntp.query(&sample))
+    {
+        analyzer.add(ntp.timeBase().at(sample.local_us), sample.local_us);
+    }
+    else if (ntp.timeBase().valid())
+    {
+        // Fill the gap with the prediction of the time base.
+        int64_t local_us = NTPTimeBase::localMicros();
+        analyzer.add(ntp.timeBase().at(local_us), local_us);
+        String error;
+        NTPClient::lastErrorString(&error);
+        Serial.println(error);
+    }
+    if (analyzer.samples() > 0 && analyzer.samples() % REPORT_EVERY == 0)
+        analyzer.printTo(Serial);
+}
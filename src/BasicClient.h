@@ -0,0 +1,288 @@
+/**
+ * @file BasicClient.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "MessageTransport.h"
+#include "NTPClock.h"
+#include "NTPEngine.h"
+#include "UdpTransport.h"
+#include <Arduino.h>
+#include <cerrno>
+#include <cstdbool>
+#include <cstdint>
+
+/**
+ * @brief Clock policy stamping requests with an interim time, like NTPClient does before its
+ * first sample.  Samples are not kept.
+ */
+struct NTPInterimClock
+{
+    NTPTimestamp now() const
+    {
+        // Any time will do for the Transmit Timestamp as long as no two requests get the same one,
+        // else a stale or replayed reply would pass the Originate check.  The local counter
+        // never repeats.
+        return NTPTimeBase::INTERIM_EPOCH + NTPDuration::fromMicros(NTPTimeBase::localMicros());
+    }
+    void adjust(NTPTimestamp, int64_t, float) {}
+};
+
+/**
+ * @brief Clock policy disciplining a NTPTimeBase with every accepted sample.  Requests are
+ * stamped with the time base as soon as it is valid.
+ */
+class NTPDisciplinedClock
+{
+public:
+    NTPTimestamp now() const
+    {
+        return _time_base.valid() ? _time_base.now() : NTPInterimClock().now();
+    }
+    void adjust(NTPTimestamp time, int64_t local_us, float max_error)
+    {
+        _time_base.update(time, local_us, max_error);
+    }
+    const NTPTimeBase &timeBase() const { return _time_base; }
+
+private:
+    NTPTimeBase _time_base;
+};
+
+/**
+ * @brief Filter policy taking every reply the engine has accepted.
+ */
+struct NTPNoFilter
+{
+    bool accept(const NTPEngine::ntp_result &) const { return true; }
+};
+
+/**
+ * @brief Filter policy dropping samples whose root distance exceeds MAXDIST, like the selection of
+ * RFC 5905 A.5.5.2 and NTPSyncMonitor do it.
+ */
+struct NTPDistanceFilter
+{
+    static constexpr float MAXDIST = 1.5f; ///< Seconds
+
+    bool accept(const NTPEngine::ntp_result &result) const
+    {
+        return distance(result) <= MAXDIST;
+    }
+    static float distance(const NTPEngine::ntp_result &result)
+    {
+        return (float)((result.rootdelay.toSeconds() + result.delay.toSeconds()) / 2.0 + result.rootdisp.toSeconds());
+    }
+};
+
+/**
+ * @brief Logger policy printing nothing.  Both calls compile away.
+ */
+struct NTPNullLogger
+{
+    void kiss(const char *) {}
+    void failed(int) {}
+};
+
+/**
+ * @brief Logger policy printing Kiss-o'-Death codes to Serial, like NTPClient does it.
+ */
+struct NTPSerialLogger
+{
+    void kiss(const char *code) { NTPMessageTransport::printKissCode(code); }
+    void failed(int) {}
+};
+
+/**
+ * @brief A lean SNTP client put together from policies at compile time.
+ * 
+ * NTPClient brings everything: sample history, time base, sync monitor and metrics.  Here only
+ * the parts asked for are built in, every call goes to the concrete policy type and a no-op
+ * policy leaves no code behind.  NTPClient stays a class of its own, since NTPSyncService and
+ * NTPReactor take it by reference and its transport is picked at run time.
+ * 
+ * - Transport: NTPUdpTransport or NTPStaticReplayTransport, which have no virtual functions, a
+ *   NTPMessageTransport or any class with beginExchange(), pollExchange(), packetExchange(),
+ *   cancelExchange(), txMicros() and rxMicros() like them.
+ * - Clock: now() gives the Transmit Timestamp of a request, adjust(time, local_us, max_error)
+ *   takes the synchronized time of each accepted sample.
+ * - Filter: accept(result) tells whether a sample checked by NTPEngine is taken.
+ * - Logger: kiss(code) and failed(errno) are told about Kiss-o'-Death replies and failures.
+ * 
+ * The server is set on the transport with setServerName().  Errors are
+ * reported by errno like NTPClient does it.  A sample dropped by the filter fails with
+ * ERANGE.  Timeouts are measured with millis().
+ * 
+ * \sa NTPDefaultClient, NTPTinyClient, NTPDisciplinedBasicClient
+ */
+template <class Transport = NTPUdpTransport, class Clock = NTPInterimClock, class Filter = NTPNoFilter,
+          class Logger = NTPSerialLogger>
+class NTPBasicClient
+{
+public:
+    static constexpr unsigned long TIMEOUT = 1024UL; ///< Milliseconds to wait for a reply.
+
+    explicit NTPBasicClient(Transport &transport) : _transport(transport) {}
+    NTPBasicClient(const NTPBasicClient &) = delete;
+    NTPBasicClient &operator=(const NTPBasicClient &) = delete;
+
+    Transport &transport() { return _transport; }
+    Clock &clock() { return _clock; }
+    Filter &filter() { return _filter; }
+    Logger &logger() { return _logger; }
+
+    /**
+     * @brief Queries the server and waits for the reply.
+     * 
+     * @param[out] result Receives the checked reply with offset and delay.  May be nullptr.
+     * @param timeout Milliseconds to wait for the reply.
+     * @return true if a sample has been taken, false if not.  errno tells why.
+     */
+    bool query(NTPEngine::ntp_result *result = nullptr, unsigned long timeout = TIMEOUT)
+    {
+        if (_pending)
+        {
+            // Only one query at a time.
+            errno = EALREADY;
+            return false;
+        }
+        NTPEngine::buildRequest(_clock.now(), reinterpret_cast<uint8_t *>(&_packet), sizeof(_packet), &_request);
+        if (_transport.packetExchange(&_packet, timeout) == false)
+        {
+            // Error code has been set.
+            return failed();
+        }
+        return finish(result);
+    }
+
+    /**
+     * @brief Starts a query without waiting for the reply.  Call pollQuery() until it is finished.
+     * 
+     * @param timeout Milliseconds to wait for the reply.
+     * @return true if the request has been sent, false if not.  errno tells why.
+     */
+    bool startQuery(unsigned long timeout = TIMEOUT)
+    {
+        if (timeout == 0)
+        {
+            // Invalid argument.
+            errno = EINVAL;
+            return false;
+        }
+        if (_pending)
+        {
+            // Only one query at a time.
+            errno = EALREADY;
+            return false;
+        }
+        NTPEngine::buildRequest(_clock.now(), reinterpret_cast<uint8_t *>(&_packet), sizeof(_packet), &_request);
+        if (_transport.beginExchange(&_packet) == false)
+        {
+            // Error code has been set.
+            return failed();
+        }
+        _start_millis = millis();
+        _timeout = timeout;
+        _pending = true;
+        return true;
+    }
+
+    /**
+     * @brief Checks for the reply of a query started by startQuery().
+     * 
+     * @param[out] result Receives the checked reply with offset and delay.  May be nullptr.
+     * @return true if a sample has been taken.  false if the query is still pending (errno is
+     * EINPROGRESS then) or has failed (errno tells why, ETIMEDOUT if there was no reply in time).
+     */
+    bool pollQuery(NTPEngine::ntp_result *result = nullptr)
+    {
+        if (!_pending)
+        {
+            // There is nothing to poll for.
+            errno = EINVAL;
+            return false;
+        }
+        if (_transport.pollExchange(&_packet) == false)
+        {
+            if (errno != EINPROGRESS)
+            {
+                // Error code has been set.
+                _pending = false;
+                return failed();
+            }
+            if (millis() - _start_millis >= _timeout)
+            {
+                _transport.cancelExchange();
+                _pending = false;
+                errno = ETIMEDOUT;
+                return failed();
+            }
+            return false;
+        }
+        _pending = false;
+        return finish(result);
+    }
+
+    bool queryPending() const { return _pending; }
+
+private:
+    bool failed()
+    {
+        _logger.failed(errno);
+        return false;
+    }
+
+    bool finish(NTPEngine::ntp_result *result)
+    {
+        // T4 is T1 plus the round trip on the local microseconds clock, q.v. NTPClient::take_sample().
+        NTPEngine::ntp_result sample;
+        NTPTimestamp t4 = NTPTimestamp::decode(_request.xmt) +
+                          NTPDuration::fromMicros(_transport.rxMicros() - _transport.txMicros());
+        if (NTPEngine::processReply(_request, reinterpret_cast<const uint8_t *>(&_packet), sizeof(_packet), t4,
+                                    &sample) == false)
+        {
+            if (sample.error == EAGAIN)
+                _logger.kiss(sample.kiss_code);
+            errno = sample.error;
+            return failed();
+        }
+        if (_filter.accept(sample) == false)
+        {
+            // The sample is too far off to be used.
+            errno = ERANGE;
+            return failed();
+        }
+        int64_t local_us = NTPTimeBase::localMicros() - (int64_t)(unsigned long)(micros() - _transport.rxMicros());
+        _clock.adjust(sample.t4 + sample.offset, local_us, NTPDistanceFilter::distance(sample));
+        if (result)
+            *result = sample;
+        return true;
+    }
+
+    Transport &_transport;
+    Clock _clock;
+    Filter _filter;
+    Logger _logger;
+    NTPMessageTransport::ntp_packet _packet;
+    NTPEngine::ntp_request _request = {0};
+    unsigned long _start_millis = 0;
+    unsigned long _timeout = 0;
+    bool _pending = false;
+};
+
+/// Same request and checks of the reply as NTPClient, KoD printed.  There is no sample history,
+/// time base, sync monitor or metrics.
+using NTPDefaultClient = NTPBasicClient<>;
+/// Smallest client: no time base, no filter, prints nothing.
+using NTPTinyClient = NTPBasicClient<NTPUdpTransport, NTPInterimClock, NTPNoFilter, NTPNullLogger>;
+/// Client keeping a disciplined NTPTimeBase fed with filtered samples.
+using NTPDisciplinedBasicClient =
+    NTPBasicClient<NTPUdpTransport, NTPDisciplinedClock, NTPDistanceFilter, NTPSerialLogger>;
@@ -0,0 +1,319 @@
+/**
+ * @file ClientMetrics.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "ClientMetrics.h"
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @brief Counts a query that has been started.
+ */
+void NTPClientMetrics::queryStarted()
+{
+    _queries.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a failed query by its errno.
+ */
+void NTPClientMetrics::queryFailed(int error)
+{
+    failure_reason reason;
+    switch (error)
+    {
+    case ETIMEDOUT:
+        reason = FAIL_TIMEOUT;
+        break;
+    case EAGAIN:
+        reason = FAIL_KOD;
+        break;
+    case ENODATA:
+        reason = FAIL_UNSYNCHRONIZED;
+        break;
+    case EBADMSG:
+        reason = FAIL_BAD_MESSAGE;
+        break;
+    case EOPNOTSUPP:
+    case EPROTONOSUPPORT:
+    case EPFNOSUPPORT:
+        reason = FAIL_PROTOCOL;
+        break;
+    case ERANGE:
+        reason = FAIL_FILTERED;
+        break;
+    default:
+        reason = FAIL_NETWORK;
+        break;
+    }
+    _failures[reason].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a Kiss-o'-Death packet.
+ * 
+ * @param code The four character kiss code.
+ */
+void NTPClientMetrics::kissReceived(const char *code)
+{
+    kiss_code kod = KOD_OTHER;
+    if (strncmp(code, "RATE", 4) == 0)
+        kod = KOD_RATE;
+    else if ((strncmp(code, "DENY", 4) == 0) || (strncmp(code, "RSTR", 4) == 0))
+        kod = KOD_DENY;
+    _kod[kod].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a sample and updates the gauges.
+ * 
+ * @param offset Clock offset in seconds.
+ * @param delay Round-trip delay in seconds.
+ * @param rtt_us Round-trip as measured locally in microseconds, including the server.
+ */
+void NTPClientMetrics::sampleTaken(float offset, float delay, uint32_t rtt_us)
+{
+    // Jitter like RFC 5905 A.5.2 clock_filter() averages it.
+    if (_has_offset)
+    {
+        float diff = offset - _offset.load(std::memory_order_relaxed);
+        _jitter_square += (diff * diff - _jitter_square) / 4.0f;
+        _jitter.store(sqrtf(_jitter_square), std::memory_order_relaxed);
+    }
+    _has_offset = true;
+    _offset.store(offset, std::memory_order_relaxed);
+    _delay.store(delay, std::memory_order_relaxed);
+    _samples.fetch_add(1, std::memory_order_relaxed);
+    _rtt.record(rtt_us);
+}
+
+/**
+ * @brief Sets everything back to 0.
+ */
+void NTPClientMetrics::reset()
+{
+    _queries.store(0, std::memory_order_relaxed);
+    _samples.store(0, std::memory_order_relaxed);
+    for (auto &failures : _failures)
+        failures.store(0, std::memory_order_relaxed);
+    for (auto &kod : _kod)
+        kod.store(0, std::memory_order_relaxed);
+    _offset.store(0.0f, std::memory_order_relaxed);
+    _delay.store(0.0f, std::memory_order_relaxed);
+    _jitter.store(0.0f, std::memory_order_relaxed);
+    _rtt.reset();
+    _jitter_square = 0.0f;
+    _has_offset = false;
+}
+
+/**
+ * @brief Copies all values.  Every value is consistent in itself, not necessarily with the others.
+ */
+void NTPClientMetrics::snapshot(metrics_snapshot *snapshot) const
+{
+    if (snapshot == nullptr)
+        return;
+    snapshot->queries = _queries.load(std::memory_order_relaxed);
+    snapshot->samples = _samples.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FAIL_COUNT; i++)
+        snapshot->failures[i] = _failures[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < KOD_COUNT; i++)
+        snapshot->kod[i] = _kod[i].load(std::memory_order_relaxed);
+    snapshot->offset = _offset.load(std::memory_order_relaxed);
+    snapshot->delay = _delay.load(std::memory_order_relaxed);
+    snapshot->jitter = _jitter.load(std::memory_order_relaxed);
+    snapshot->rtt_us_sum = _rtt.sum();
+    snapshot->rtt_us_p50 = _rtt.percentile(0.50);
+    snapshot->rtt_us_p90 = _rtt.percentile(0.90);
+    snapshot->rtt_us_p99 = _rtt.percentile(0.99);
+    snapshot->rtt_us_max = _rtt.max();
+}
+
+/**
+ * @brief Histogram of the round-trips in microseconds, for percentiles of your own or merging.
+ */
+const NTPHistogram &NTPClientMetrics::rtt() const
+{
+    return _rtt;
+}
+
+/**
+ * @brief Prints the snapshot as one line of JSON.
+ */
+void NTPClientMetrics::printJson(Print &out) const
+{
+    metrics_snapshot values;
+    snapshot(&values);
+    out.print(F("{\"queries\":"));
+    out.print(values.queries);
+    out.print(F(",\"samples\":"));
+    out.print(values.samples);
+    out.print(F(",\"failures\":{"));
+    for (size_t i = 0; i < FAIL_COUNT; i++)
+    {
+        out.print(i == 0 ? F("\"") : F(",\""));
+        out.print(reasonName((failure_reason)i));
+        out.print(F("\":"));
+        out.print(values.failures[i]);
+    }
+    out.print(F("},\"kod\":{"));
+    for (size_t i = 0; i < KOD_COUNT; i++)
+    {
+        out.print(i == 0 ? F("\"") : F(",\""));
+        out.print(kissName((kiss_code)i));
+        out.print(F("\":"));
+        out.print(values.kod[i]);
+    }
+    out.print(F("},\"offset\":"));
+    out.print(values.offset, 6);
+    out.print(F(",\"delay\":"));
+    out.print(values.delay, 6);
+    out.print(F(",\"jitter\":"));
+    out.print(values.jitter, 6);
+    out.print(F(",\"rtt_us_sum\":"));
+    out.print(values.rtt_us_sum);
+    out.print(F(",\"rtt_us_p50\":"));
+    out.print(values.rtt_us_p50);
+    out.print(F(",\"rtt_us_p90\":"));
+    out.print(values.rtt_us_p90);
+    out.print(F(",\"rtt_us_p99\":"));
+    out.print(values.rtt_us_p99);
+    out.print(F(",\"rtt_us_max\":"));
+    out.print(values.rtt_us_max);
+    out.println(F("}"));
+}
+
+/**
+ * @brief Prints the metrics in the Prometheus text exposition format.
+ * 
+ * @param out Where to print to.
+ * @param prefix Prefix of the metric names.
+ */
+void NTPClientMetrics::printPrometheus(Print &out, const char *prefix) const
+{
+    metrics_snapshot values;
+    snapshot(&values);
+
+    auto header = [&](const char *name, const char *type, const __FlashStringHelper *help) {
+        out.print(F("# HELP "));
+        out.print(prefix);
+        out.print(name);
+        out.print(' ');
+        out.println(help);
+        out.print(F("# TYPE "));
+        out.print(prefix);
+        out.print(name);
+        out.print(' ');
+        out.println(type);
+    };
+    auto gauge = [&](const char *name, const __FlashStringHelper *help, float value) {
+        header(name, "gauge", help);
+        out.print(prefix);
+        out.print(name);
+        out.print(' ');
+        out.println(value, 6);
+    };
+
+    header("_queries_total", "counter", F("Queries started."));
+    out.print(prefix);
+    out.print(F("_queries_total "));
+    out.println(values.queries);
+    header("_samples_total", "counter", F("Queries giving a sample."));
+    out.print(prefix);
+    out.print(F("_samples_total "));
+    out.println(values.samples);
+    header("_failures_total", "counter", F("Failed queries by reason."));
+    for (size_t i = 0; i < FAIL_COUNT; i++)
+    {
+        out.print(prefix);
+        out.print(F("_failures_total{reason=\""));
+        out.print(reasonName((failure_reason)i));
+        out.print(F("\"} "));
+        out.println(values.failures[i]);
+    }
+    header("_kod_total", "counter", F("Kiss-o'-Death packets by code."));
+    for (size_t i = 0; i < KOD_COUNT; i++)
+    {
+        out.print(prefix);
+        out.print(F("_kod_total{code=\""));
+        out.print(kissName((kiss_code)i));
+        out.print(F("\"} "));
+        out.println(values.kod[i]);
+    }
+    gauge("_offset_seconds", F("Clock offset of the last sample."), values.offset);
+    gauge("_delay_seconds", F("Round-trip delay of the last sample."), values.delay);
+    gauge("_jitter_seconds", F("Jitter of the offset."), values.jitter);
+
+    // Powers of two are bucket boundaries of the histogram, so the counts are exact.  The values
+    // are whole microseconds: up to 2^k - 1 us is the same as below 2^k us.
+    header("_rtt_seconds", "histogram", F("Round-trip time of the exchanges."));
+    for (unsigned int k = NTPHistogram::SUB_BUCKET_BITS; k <= RTT_MAX_LOG2; k++)
+    {
+        uint32_t le_us = (1UL << k) - 1U;
+        out.print(prefix);
+        out.print(F("_rtt_seconds_bucket{le=\""));
+        out.print(le_us / 1e6, 6);
+        out.print(F("\"} "));
+        out.println(_rtt.countAtOrBelow(le_us));
+    }
+    uint32_t count = _rtt.count();
+    out.print(prefix);
+    out.print(F("_rtt_seconds_bucket{le=\"+Inf\"} "));
+    out.println(count);
+    out.print(prefix);
+    out.print(F("_rtt_seconds_sum "));
+    out.println(values.rtt_us_sum / 1e6, 6);
+    out.print(prefix);
+    out.print(F("_rtt_seconds_count "));
+    out.println(count);
+}
+
+/**
+ * @brief Label of a failure reason.
+ */
+const char *NTPClientMetrics::reasonName(failure_reason reason)
+{
+    switch (reason)
+    {
+    case FAIL_TIMEOUT:
+        return "timeout";
+    case FAIL_KOD:
+        return "kod";
+    case FAIL_UNSYNCHRONIZED:
+        return "unsynchronized";
+    case FAIL_BAD_MESSAGE:
+        return "bad_message";
+    case FAIL_PROTOCOL:
+        return "protocol";
+    case FAIL_FILTERED:
+        return "filtered";
+    case FAIL_NETWORK:
+    default:
+        return "network";
+    }
+}
+
+/**
+ * @brief Label of a kiss code class.
+ */
+const char *NTPClientMetrics::kissName(kiss_code code)
+{
+    switch (code)
+    {
+    case KOD_RATE:
+        return "RATE";
+    case KOD_DENY:
+        return "DENY";
+    case KOD_OTHER:
+    default:
+        return "other";
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file ClientMetrics.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "Histogram.h"
+#include <Print.h>
+#include <atomic>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Counters, gauges and the round-trip histogram of a NTPClient for fleet monitoring.
+ * 
+ * The client updates them on every query with relaxed atomic increments and stores only, so
+ * counting costs next to nothing and they can be read from any task.  Read them
+ * - as a plain snapshot struct, compact enough to be sent as it is,
+ * - as one JSON object, or
+ * - in the Prometheus text exposition format, e.g. into the client of an ESP8266WebServer or
+ *   WebServer handler serving /metrics.
+ */
+class NTPClientMetrics
+{
+public:
+    enum failure_reason : uint8_t
+    {
+        FAIL_TIMEOUT,        ///< ETIMEDOUT: no reply in time
+        FAIL_KOD,            ///< EAGAIN: Kiss-o'-Death
+        FAIL_UNSYNCHRONIZED, ///< ENODATA: server clock not synchronized
+        FAIL_BAD_MESSAGE,    ///< EBADMSG: reply does not belong to the request
+        FAIL_PROTOCOL,       ///< EOPNOTSUPP, EPROTONOSUPPORT, EPFNOSUPPORT: unusable reply
+        FAIL_FILTERED,       ///< ERANGE: sample dropped for its root distance
+        FAIL_NETWORK,        ///< everything else: no WiFi, name resolution, socket
+        FAIL_COUNT
+    };
+
+    enum kiss_code : uint8_t
+    {
+        KOD_RATE,  ///< rate exceeded, back off
+        KOD_DENY,  ///< DENY or RSTR: access denied, stop asking
+        KOD_OTHER,
+        KOD_COUNT
+    };
+
+    static constexpr unsigned int RTT_MAX_LOG2 = 22; ///< Prometheus buckets go up to 2^22 us
+
+    struct metrics_snapshot
+    {
+        uint32_t queries;                 ///< queries started
+        uint32_t samples;                 ///< queries giving a sample
+        uint32_t failures[FAIL_COUNT];    ///< failed queries by reason
+        uint32_t kod[KOD_COUNT];          ///< Kiss-o'-Death packets by code
+        float offset;                     ///< offset of the last sample (s)
+        float delay;                      ///< round-trip delay of the last sample (s)
+        float jitter;                     ///< RMS of the offset differences of successive samples (s)
+        uint32_t rtt_us_sum;              ///< sum of all round-trips (us), wraps like a counter reset
+        uint32_t rtt_us_p50;              ///< median round-trip (us)
+        uint32_t rtt_us_p90;
+        uint32_t rtt_us_p99;
+        uint32_t rtt_us_max;
+    };
+
+    void queryStarted();
+    void queryFailed(int error);
+    void kissReceived(const char *code);
+    void sampleTaken(float offset, float delay, uint32_t rtt_us);
+    void reset();
+
+    void snapshot(metrics_snapshot *snapshot) const;
+    const NTPHistogram &rtt() const;
+    void printJson(Print &out) const;
+    void printPrometheus(Print &out, const char *prefix = "sntp_client") const;
+    static const char *reasonName(failure_reason reason);
+    static const char *kissName(kiss_code code);
+
+private:
+    std::atomic<uint32_t> _queries{0};
+    std::atomic<uint32_t> _samples{0};
+    std::atomic<uint32_t> _failures[FAIL_COUNT] = {};
+    std::atomic<uint32_t> _kod[KOD_COUNT] = {};
+    std::atomic<float> _offset{0.0f};
+    std::atomic<float> _delay{0.0f};
+    std::atomic<float> _jitter{0.0f};
+    NTPHistogram _rtt; ///< round-trips in us
+    // Only touched by the task running the client.
+    float _jitter_square = 0.0f;
+    bool _has_offset = false;
+};
@@ -0,0 +1,163 @@
+/**
+ * @file Histogram.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "Histogram.h"
+#include <cmath>
+
+/**
+ * @brief Counts a value.
+ */
+void NTPHistogram::record(uint32_t value)
+{
+    _counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    while ((value > max) && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Adds the counts of another histogram to this one.
+ */
+void NTPHistogram::merge(const NTPHistogram &other)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        uint32_t count = other._counts[i].load(std::memory_order_relaxed);
+        if (count != 0)
+            _counts[i].fetch_add(count, std::memory_order_relaxed);
+    }
+    _count.fetch_add(other._count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    _sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint32_t value = other._max.load(std::memory_order_relaxed);
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    while ((value > max) && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * @brief Sets all counts back to 0.
+ */
+void NTPHistogram::reset()
+{
+    for (auto &count : _counts)
+        count.store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Number of values recorded.
+ */
+uint32_t NTPHistogram::count() const
+{
+    return _count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sum of the values recorded, modulo 2^32.
+ */
+uint32_t NTPHistogram::sum() const
+{
+    return _sum.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Largest value recorded.
+ */
+uint32_t NTPHistogram::max() const
+{
+    return _max.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief The value below or at which the given share of the values lies.
+ * 
+ * @param p Share between 0.0 and 1.0, e.g. 0.99 for the 99th percentile.
+ * @return Highest value of the bucket holding the percentile, but not more than max().  0 if empty.
+ */
+uint32_t NTPHistogram::percentile(double p) const
+{
+    uint32_t total = 0;
+    for (const auto &count : _counts)
+        total += count.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    if (p < 0.0)
+        p = 0.0;
+    if (p > 1.0)
+        p = 1.0;
+    uint32_t rank = (uint32_t)ceil(p * total);
+    if (rank == 0)
+        rank = 1;
+    uint32_t seen = 0;
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += _counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            uint32_t highest = highestOf(i);
+            return (highest < max) ? highest : max;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief Number of values not greater than value.  Exact if value is the highest of its bucket.
+ */
+uint32_t NTPHistogram::countAtOrBelow(uint32_t value) const
+{
+    size_t last = bucketOf(value);
+    uint32_t seen = 0;
+    for (size_t i = 0; i <= last; i++)
+        seen += _counts[i].load(std::memory_order_relaxed);
+    return seen;
+}
+
+/**
+ * @brief Index of the bucket counting the given value.
+ */
+size_t NTPHistogram::bucketOf(uint32_t value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+    unsigned int msb = 31U - (unsigned int)__builtin_clz(value);
+    unsigned int shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1U) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+}
+
+/**
+ * @brief Smallest value counted by the given bucket.
+ */
+uint32_t NTPHistogram::lowestOf(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return (uint32_t)bucket;
+    unsigned int shift = (unsigned int)(bucket / SUB_BUCKETS) - 1U;
+    uint32_t sub = (uint32_t)(bucket % SUB_BUCKETS) + SUB_BUCKETS;
+    return sub << shift;
+}
+
+/**
+ * @brief Largest value counted by the given bucket.
+ */
+uint32_t NTPHistogram::highestOf(size_t bucket)
+{
+    if (bucket + 1 >= BUCKETS)
+        return UINT32_MAX;
+    return lowestOf(bucket + 1) - 1U;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file Histogram.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Log-linear histogram of 32 bit values like HdrHistogram keeps them.
+ * 
+ * Values below SUB_BUCKETS have a bucket each.  Above, every power of two is split into
+ * SUB_BUCKETS linear buckets, so the bucket width is at most 1/SUB_BUCKETS of the value
+ * (6.25 %) over the whole range of uint32_t.  That takes BUCKETS counters, less than 2 KB.
+ * 
+ * record() finds the bucket with a count-leading-zeros and a shift and does relaxed atomic
+ * increments, so any task or interrupt may record without locks.  Histograms filled by
+ * different tasks can be merged for reporting.
+ */
+class NTPHistogram
+{
+public:
+    static constexpr unsigned int SUB_BUCKET_BITS = 4;
+    static constexpr uint32_t SUB_BUCKETS = 1UL << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = (33 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    void record(uint32_t value);
+    void merge(const NTPHistogram &other);
+    void reset();
+
+    uint32_t count() const;
+    uint32_t sum() const;
+    uint32_t max() const;
+    uint32_t percentile(double p) const;
+    uint32_t countAtOrBelow(uint32_t value) const;
+
+    static size_t bucketOf(uint32_t value);
+    static uint32_t lowestOf(size_t bucket);
+    static uint32_t highestOf(size_t bucket);
+
+private:
+    std::atomic<uint32_t> _counts[BUCKETS] = {};
+    std::atomic<uint32_t> _count{0};
+    std::atomic<uint32_t> _sum{0}; ///< wraps like a counter
+    std::atomic<uint32_t> _max{0};
+};
@@ -0,0 +1,280 @@
+/**
+ * @file LwipTransport.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "LwipTransport.h"
+
+#if defined(ESP32) || defined(ESP8266)
+#include <Arduino.h>
+#include <cerrno>
+#include <cstring>
+#if defined(ESP32)
+#include <lwip/tcpip.h>
+#endif
+
+namespace
+{
+    /// Arguments and result of a call into lwIP.
+    struct lwip_call
+    {
+#if defined(ESP32)
+        struct tcpip_api_call_data base; ///< Must come first, tcpip_api_call() gets its address.
+#endif
+        err_t (*fn)(lwip_call *call);
+        struct udp_pcb *pcb;
+        struct pbuf *pbuf;
+        const ip_addr_t *addr;
+        uint16_t port;
+        udp_recv_fn recv;
+        void *recv_arg;
+        ip_addr_t *server_addr;
+    };
+
+#if defined(ESP32)
+    err_t trampoline(struct tcpip_api_call_data *data)
+    {
+        lwip_call *call = reinterpret_cast<lwip_call *>(data);
+        return call->fn(call);
+    }
+#endif
+
+    /// Runs the call where lwIP may be used: in the lwIP task on the ESP32, right here on the ESP8266.
+    err_t run_in_lwip(lwip_call *call)
+    {
+#if defined(ESP32)
+        return tcpip_api_call(trampoline, &call->base);
+#else
+        return call->fn(call);
+#endif
+    }
+
+    err_t do_open(lwip_call *call)
+    {
+        call->pcb = udp_new();
+        if (call->pcb == nullptr)
+            return ERR_MEM;
+        err_t err = udp_bind(call->pcb, IP_ADDR_ANY, call->port);
+        if (err != ERR_OK)
+        {
+            udp_remove(call->pcb);
+            call->pcb = nullptr;
+            return err;
+        }
+        udp_recv(call->pcb, call->recv, call->recv_arg);
+        return ERR_OK;
+    }
+
+    err_t do_send(lwip_call *call)
+    {
+        // The receive callback compares against the server address in this context.
+        ip_addr_copy(*call->server_addr, *call->addr);
+        return udp_sendto(call->pcb, call->pbuf, call->server_addr, call->port);
+    }
+
+    err_t do_close(lwip_call *call)
+    {
+        udp_remove(call->pcb);
+        return ERR_OK;
+    }
+}
+
+NTPLwipTransport::NTPLwipTransport()
+{
+    // No replies are taken before the first request has named the server.
+    ip_addr_set_zero(&_server_addr);
+}
+
+NTPLwipTransport::~NTPLwipTransport()
+{
+    close_sockets();
+}
+
+/**
+ * @brief Sets a function to be called when a reply has arrived.
+ * 
+ * @param handler The function or nullptr.  It runs in the lwIP context, keep it short.
+ * @param arg Passed to the handler.
+ * 
+ * The callback never sees a handler without its argument.  Replace a handler while no exchange
+ * is pending, a reply arriving right then may still get the old one.
+ */
+void NTPLwipTransport::setReceiveHandler(receive_handler handler, void *arg)
+{
+    _handler.store(nullptr, std::memory_order_release);
+    _handler_arg.store(arg, std::memory_order_relaxed);
+    _handler.store(handler, std::memory_order_release);
+}
+
+/**
+ * @brief Local UDP port, 0 before the first exchange.
+ */
+uint16_t NTPLwipTransport::localPort() const
+{
+    return (_pcb != nullptr) ? _pcb->local_port : 0;
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+bool NTPLwipTransport::net_provider()
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        // Unable to handle this here.  Giving up.
+        errno = ENETDOWN;
+        return false;
+    }
+    if (_pcb != nullptr)
+    {
+        return true;
+    }
+    lwip_call call = {};
+    call.fn = do_open;
+    call.port = local_port_setting();
+    call.recv = &NTPLwipTransport::on_receive;
+    call.recv_arg = this;
+    if (run_in_lwip(&call) != ERR_OK)
+    {
+        // The port is taken or lwIP is out of memory.
+        errno = EISCONN;
+        return false;
+    }
+    _pcb = call.pcb;
+    return true;
+}
+
+/**
+ * @brief Removes the pcb, so a changed local port takes effect with the next exchange.
+ */
+void NTPLwipTransport::close_sockets()
+{
+    if (_pcb != nullptr)
+    {
+        lwip_call call = {};
+        call.fn = do_close;
+        call.pcb = _pcb;
+        run_in_lwip(&call);
+        _pcb = nullptr;
+    }
+    drop_reply();
+    NTPMessageTransport::close_sockets();
+}
+
+bool NTPLwipTransport::send_server_request(struct ntp_packet *ntp_request)
+{
+    if (ntp_request == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (resolve_server() == false)
+    {
+        // Error code has been set.
+        return false;
+    }
+    // A late reply of an abandoned exchange would be taken for the reply to this one.
+    drop_reply();
+
+    IPAddress server = serverAddress();
+    ip_addr_t server_addr;
+    IP_ADDR4(&server_addr, server[0], server[1], server[2], server[3]);
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, sizeof(struct ntp_packet), PBUF_RAM);
+    if (p == nullptr)
+    {
+        // Out of memory.
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(p->payload, ntp_request, sizeof(struct ntp_packet));
+    lwip_call call = {};
+    call.fn = do_send;
+    call.pcb = _pcb;
+    call.pbuf = p;
+    call.addr = &server_addr;
+    call.server_addr = &_server_addr;
+    call.port = NTP_SERVER_PORT;
+    err_t err = run_in_lwip(&call);
+    pbuf_free(p);
+    if (err != ERR_OK)
+    {
+        // The packet has not been sent correctly.
+        errno = EIO;
+        return false;
+    }
+    _tx_micros = micros();
+    return true;
+}
+
+bool NTPLwipTransport::poll_server_reply(struct ntp_packet *ntp_reply)
+{
+    if (ntp_reply == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    struct pbuf *p = _reply.exchange(nullptr, std::memory_order_acquire);
+    if (p == nullptr)
+    {
+        // Nothing arrived yet.
+        errno = EINPROGRESS;
+        return false;
+    }
+    _rx_micros = _reply_micros;
+    // The reply may be spread over a chain of pbufs.  Either way this is the only copy.
+    uint16_t copied = pbuf_copy_partial(p, ntp_reply, sizeof(struct ntp_packet), 0);
+    pbuf_free(p);
+    if (copied != sizeof(struct ntp_packet))
+    {
+        // The I/O buffer was lost or too small to hold this amount of data.
+        errno = EOVERFLOW;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive callback of lwIP.  Takes the arrival time first, then hands the pbuf over.
+ */
+void NTPLwipTransport::on_receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    (void)pcb;
+    unsigned long now_micros = micros();
+    NTPLwipTransport *self = static_cast<NTPLwipTransport *>(arg);
+    if ((p == nullptr) || (port != NTP_SERVER_PORT) || !ip_addr_cmp(addr, &self->_server_addr) ||
+        (p->tot_len < sizeof(struct ntp_packet)))
+    {
+        // Not from our server or too small to be valid.
+        if (p != nullptr)
+            pbuf_free(p);
+        return;
+    }
+    self->_reply_micros = now_micros;
+    struct pbuf *older = self->_reply.exchange(p, std::memory_order_release);
+    if (older != nullptr)
+        pbuf_free(older);
+    receive_handler handler = self->_handler.load(std::memory_order_acquire);
+    if (handler != nullptr)
+        handler(self->_handler_arg.load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Throws away a reply that has not been picked up.
+ */
+void NTPLwipTransport::drop_reply()
+{
+    struct pbuf *p = _reply.exchange(nullptr, std::memory_order_acquire);
+    if (p != nullptr)
+        pbuf_free(p);
+}
+
+#endif
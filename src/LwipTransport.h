@@ -0,0 +1,75 @@
+/**
+ * @file LwipTransport.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+// lwIP comes with the ESP8266 and the ESP32 Arduino cores.
+#if defined(ESP32) || defined(ESP8266)
+
+#include "MessageTransport.h"
+#include <atomic>
+#include <cstdbool>
+#include <cstdint>
+#include <lwip/pbuf.h>
+#include <lwip/udp.h>
+
+/**
+ * @brief Transport talking to lwIP's raw UDP API instead of WiFiUDP.
+ * 
+ * WiFiUDP copies every datagram into a buffer of its own and only sees it when parsePacket() is
+ * called.  Here lwIP calls back as soon as the reply is there: the callback takes the arrival
+ * time right away and keeps the pbuf as it is.  pollExchange() copies its 48 bytes once into
+ * the reply.  That makes T4 independent of how often the reply is polled for.
+ * 
+ * The receive handler is called from the callback, e.g. to wake the NTPSyncService:
+ * 
+ *     transport.setReceiveHandler([](void *service) {
+ *         static_cast<NTPSyncService *>(service)->notifyReceive();
+ *     }, &service);
+ * 
+ * On the ESP32 the callback runs in the lwIP task, so the pcb is only touched through
+ * tcpip_api_call().  The ESP8266 has just one context anyway.
+ * 
+ * setLocalPort() is honoured, with ephemeral ports lwIP picks one port for the transport.  A
+ * change of the port closes the pcb, the next exchange binds a new one.
+ */
+class NTPLwipTransport : public NTPMessageTransport
+{
+public:
+    typedef void (*receive_handler)(void *arg);
+
+    NTPLwipTransport();
+    ~NTPLwipTransport() override;
+    NTPLwipTransport(const NTPLwipTransport &) = delete;
+    NTPLwipTransport &operator=(const NTPLwipTransport &) = delete;
+
+    void setReceiveHandler(receive_handler handler, void *arg);
+    uint16_t localPort() const override;
+
+protected:
+    bool net_provider() override;
+    bool send_server_request(struct ntp_packet *ntp_request) override;
+    bool poll_server_reply(struct ntp_packet *ntp_reply) override;
+    void close_sockets() override;
+
+    static void on_receive(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+    void drop_reply();
+
+private:
+    struct udp_pcb *_pcb = nullptr;
+    ip_addr_t _server_addr;                   ///< Replies from elsewhere are dropped.  Written in the lwIP context.
+    std::atomic<struct pbuf *> _reply{nullptr}; ///< Reply handed over by the callback.
+    volatile unsigned long _reply_micros = 0;  ///< micros() in the callback, valid with _reply.
+    std::atomic<receive_handler> _handler{nullptr}; ///< Published after _handler_arg.
+    std::atomic<void *> _handler_arg{nullptr};
+};
+
+#endif
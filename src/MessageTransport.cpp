@@ -91,25 +91,112 @@ bool NTPMessageTransport::packetExchange(struct ntp_packet *packet, unsigned lon
         errno = EINVAL;
         return false;
     }
+    if (beginExchange(packet) == false)
+    {
+        // Unable to proceed.  Error code has been set.  Giving up.
+        return false;
+    }
+    _exchange_pending = false;
+    if (receive_server_reply(packet, timeout) == false)
+    {
+        // The server did not answer.  Forget its address so the next exchange resolves the
+        // name again and may get another member of a server pool.  Error code has been set.
+        _udp.forgetServer();
+        return false;
+    }
+    capture_exchange(*packet);
+    return true;
+}
+
+/**
+ * @brief Like packetExchange(), but tells the outcome by its return value instead of errno.
+ * 
+ * @return The status of this exchange.  It is taken right when the exchange ends, so no
+ * other call can have changed it.
+ */
+NTPStatus NTPMessageTransport::exchange(struct ntp_packet *packet, unsigned long timeout)
+{
+    if (packetExchange(packet, timeout) == false)
+        return NTPStatus::fromErrno(errno);
+    return NTPStatus();
+}
+
+/**
+ * @brief Sends a packet to the server without waiting for the reply.
+ * @param[in] *packet The packet for the server request.
+ * @return true if the request has been sent, false in case of failure.
+ * 
+ * Collect the reply with pollExchange().  If something goes wrong this functions sets the errno variable.
+ */
+bool NTPMessageTransport::beginExchange(struct ntp_packet *packet)
+{
+    if (packet == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
     // Assure the network resources are avaible.
     if (net_provider() == false)
     {
         // Unable to proceed.  Error code has been set.  Giving up.
         return false;
     }
+    // Keep the request for the capture sink, since the reply will overwrite it.
+    if (_capture_sink != nullptr)
+    {
+        _request = *packet;
+    }
     if (send_server_request(packet) == false)
     {
         // Unable to proceed.  Error code has been set.  Giving up.
         return false;
     }
-    if (receive_server_reply(packet, timeout) == false)
+    _exchange_pending = true;
+    return true;
+}
+
+/**
+ * @brief Looks for the reply of an exchange started by beginExchange() without blocking.
+ * @param[out] *packet Receives the reply.
+ * @return true if the reply has been received.  false if there is no reply yet (errno is EINPROGRESS
+ * then) or the exchange has failed (errno tells why).
+ */
+bool NTPMessageTransport::pollExchange(struct ntp_packet *packet)
+{
+    if ((packet == nullptr) || !_exchange_pending)
     {
-        // Unable to proceed.  Error code has been set.  Giving up.
+        // Invalid argument.
+        errno = EINVAL;
         return false;
     }
+    if (poll_server_reply(packet) == false)
+    {
+        if (errno != EINPROGRESS)
+        {
+            // Unusable reply.  Error code has been set.
+            _exchange_pending = false;
+        }
+        return false;
+    }
+    _exchange_pending = false;
+    capture_exchange(*packet);
     return true;
 }
 
+/**
+ * @brief Abandons an exchange started by beginExchange(), e.g. because it took too long.
+ */
+void NTPMessageTransport::cancelExchange()
+{
+    if (_exchange_pending)
+    {
+        // Same as a timeout of packetExchange().
+        _exchange_pending = false;
+        _udp.forgetServer();
+    }
+}
+
 /**
  * @brief NTP server name.
  * 
@@ -117,7 +204,7 @@ bool NTPMessageTransport::packetExchange(struct ntp_packet *packet, unsigned lon
  */
 String NTPMessageTransport::serverName() const
 {
-    return _server_name_str;
+    return _udp.serverName();
 }
 
 /**
@@ -127,7 +214,67 @@ String NTPMessageTransport::serverName() const
  */
 void NTPMessageTransport::setServerName(const char *ntp_server_name)
 {
-    _server_name_str = ntp_server_name;
+    _udp.setServerName(ntp_server_name);
+}
+
+/**
+ * @brief Uses a fixed local UDP port, DEFAULT_LOCAL_PORT unless told otherwise.
+ * 
+ * @param port The port.  Give every transport its own one if there are several.
+ * @return true if ok, false if the port is 0 (errno is EINVAL).
+ * 
+ * Open sockets are closed, a pending exchange is abandoned.  The port is opened with the next exchange.
+ * Better set it before the first exchange, q.v. the remark on stop() in net_provider().
+ */
+bool NTPMessageTransport::setLocalPort(uint16_t port)
+{
+    if (port == 0)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    cancelExchange();
+    close_sockets();
+    _udp.setLocalPort(port);
+    return true;
+}
+
+/**
+ * @brief Uses random ephemeral ports, moving to a new one after every exchanges_per_port exchanges.
+ * 
+ * @param exchanges_per_port Exchanges on one port, 0 to keep the first port for good.
+ * 
+ * Several transports do not get into each other's way and do not collide with other software.
+ * Moving on changes the source port, so NAT mappings are not reused for longer than
+ * exchanges_per_port exchanges, and late replies to the previous port are dropped by the stack.
+ * There is one socket and one exchange at a time; for concurrent exchanges use one transport and
+ * client for each of them.
+ */
+void NTPMessageTransport::setEphemeralPorts(unsigned int exchanges_per_port)
+{
+    cancelExchange();
+    close_sockets();
+    _udp.setEphemeralPorts(exchanges_per_port);
+}
+
+/**
+ * @brief Local UDP port of the current exchange, 0 if there is no open socket yet.
+ */
+uint16_t NTPMessageTransport::localPort() const
+{
+    return _udp.localPort();
+}
+
+/**
+ * @brief Address of the NTP server.
+ * 
+ * @return IPAddress the address the server name has been resolved to, or an
+ * unset address if there was no successful resolution yet.
+ */
+IPAddress NTPMessageTransport::serverAddress() const
+{
+    return _udp.serverAddress();
 }
 
 
@@ -207,33 +354,49 @@ void NTPMessageTransport::generateTstamp(tstamp64_t *dst, const uint32_t &secs,
  */
 bool NTPMessageTransport::net_provider()
 {
-    // Assure the network resources are avaible.
-    // a.) Missing network connection is a fatal error (ENETDOWN).
-    // b.) We might be able to cleanup an occupied UDP port by
-    // calling stop(). But this seems to produce a memory leak
-    // these days because of missing delete operator (EISCONN).
-    if (WiFi.status() != WL_CONNECTED)
-    {
-        // Unable to handle this here.  Giving up.
-        errno = ENETDOWN;
-        return false;
-    }
-    // If the UDP client port is open everything is ok.
-    if (_datagram.localPort() == UDP_LOCAL_PORT)
-    {
-        return true;
-    }
-    // Try to open a new UDP client port.
-    if (_datagram.localPort() == 0 && _datagram.begin(UDP_LOCAL_PORT) == true)
-    {
-        return true;
-    }
-    else
-    {
-        // Unwilling to handle this here, because of comment "b.)".  Giving up.
-        errno = EISCONN;
-        return false;
-    }
+    return _udp.open();
+}
+
+/**
+ * @brief Local send time of the last request.
+ * 
+ * @return unsigned long micros() value taken right after the request has left.
+ * 
+ * Only differences between txMicros() and rxMicros() are meaningful.  They stay
+ * correct across the wrap-around of micros() as long as they are computed unsigned.
+ */
+unsigned long NTPMessageTransport::txMicros() const
+{
+    return _tx_micros;
+}
+
+/**
+ * @brief Local arrival time of the last reply.
+ * 
+ * @return unsigned long micros() value taken right after the reply has been detected.
+ */
+unsigned long NTPMessageTransport::rxMicros() const
+{
+    return _rx_micros;
+}
+
+/**
+ * @brief Records every successful exchange.
+ * 
+ * @param sink The receiver of the exchanges or nullptr to stop recording.  The sink must
+ * outlive its use by the transport.
+ */
+void NTPMessageTransport::setCaptureSink(NTPCaptureSink *sink)
+{
+    _capture_sink = sink;
+}
+
+/**
+ * @brief Resolves the server name unless its address is already known, q.v. NTPUdpSocket::resolveServer().
+ */
+bool NTPMessageTransport::resolve_server()
+{
+    return _udp.resolveServer();
 }
 
 bool NTPMessageTransport::send_server_request(struct ntp_packet *ntp_request)
@@ -244,27 +407,30 @@ bool NTPMessageTransport::send_server_request(struct ntp_packet *ntp_request)
         errno = EINVAL;
         return false;
     }
-
-    // Execute server request.
-    if ((_datagram.beginPacket(_server_name_str.c_str(), NTP_SERVER_PORT)) != true)
-    {
-        // Cannot resolve DNS name of server.
-        errno = EADDRNOTAVAIL;
-        return false;
-    }
-    if ((_datagram.write((const uint8_t *)ntp_request, sizeof(struct ntp_packet))) != sizeof(struct ntp_packet))
+    if (_udp.send(ntp_request, sizeof(struct ntp_packet)) == false)
     {
-        // The I/O buffer was lost or too small to hold this amount of data.
-        errno = EOVERFLOW;
+        // Error code has been set.
         return false;
     }
-    if ((_datagram.endPacket()) != true)
+    _tx_micros = _udp.txMicros();
+    return true;
+}
+
+/**
+ * @brief Takes the reply if it is there.
+ * @return true if a reply has been read, false if not.  errno is EINPROGRESS if there is just nothing yet.
+ */
+bool NTPMessageTransport::poll_server_reply(struct ntp_packet *ntp_reply)
+{
+    if (ntp_reply == nullptr)
     {
-        // The packet has not been sent correctly: Dubious error / Don't know why.
-        errno = EIO;
+        // Invalid argument.
+        errno = EINVAL;
         return false;
     }
-    return true;
+    bool received = _udp.poll(ntp_reply, sizeof(struct ntp_packet));
+    _rx_micros = _udp.rxMicros();
+    return received;
 }
 
 bool NTPMessageTransport::receive_server_reply(struct ntp_packet *ntp_reply, unsigned long timeout)
@@ -275,31 +441,45 @@ bool NTPMessageTransport::receive_server_reply(struct ntp_packet *ntp_reply, uns
         errno = EINVAL;
         return false;
     }
+    // Derived transports poll their own way, so the loop calls back through poll_server_reply().
+    return NTPUdpSocket::receive([this, ntp_reply]() { return poll_server_reply(ntp_reply); }, timeout);
+}
 
-    // Network traffic section
-    int rply_size = 0;
-    unsigned long ms_cycles = 0;
-    do
-    {
-        rply_size = _datagram.parsePacket();
-        if (rply_size != 0)
-            break;
-        delay(1UL);
-    } while (++ms_cycles < timeout);
-
-    if (rply_size < (int)sizeof(struct ntp_packet))
-    {
-        // The datagram is too small to be valid.
-        errno = EPROTONOSUPPORT;
-        return false;
-    }
-    if (_datagram.read((char *)ntp_reply, sizeof(struct ntp_packet)) != sizeof(struct ntp_packet))
+/**
+ * @brief Hands a finished exchange to the capture sink if there is one.
+ */
+void NTPMessageTransport::capture_exchange(const struct ntp_packet &reply)
+{
+    if (_capture_sink != nullptr)
     {
-        // The I/O buffer was lost or too small to hold this amount of data.
-        errno = EOVERFLOW;
-        return false;
+        // T4 is T1 plus the time elapsed locally between sending and receiving.
+        NTPTimestamp t4 = NTPTimestamp::decode(_request.xmt) + NTPDuration::fromMicros(_rx_micros - _tx_micros);
+        _capture_sink->capture(_request, reply, _udp.serverAddress(), localPort(), t4.encode());
     }
-    // Finish reading the current packet
-    _datagram.flush();
-    return true;
+}
+
+/**
+ * @brief Socket of the current exchange.
+ */
+WiFiUDP &NTPMessageTransport::datagram()
+{
+    return _udp.datagram();
+}
+
+/**
+ * @brief The fixed local port or 0 if ephemeral ports are to be used.
+ */
+uint16_t NTPMessageTransport::local_port_setting() const
+{
+    return _udp.localPortSetting();
+}
+
+/**
+ * @brief Closes the socket, e.g. to move to another port.  The next exchange opens a new one.
+ * 
+ * Transports with sockets of their own override this to close them as well.
+ */
+void NTPMessageTransport::close_sockets()
+{
+    _udp.close();
 }
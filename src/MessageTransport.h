@@ -11,12 +11,22 @@
  */
 #pragma once
 
+#if defined(ESP32)
+#include <WiFi.h>
+#else
 #include <ESP8266WiFi.h>
+#endif
 #include <WiFiUdp.h>
+#include "NTPStatus.h"
+#include "NTPTimestamp.h"
+#include "UdpSocket.h"
 #include <WString.h>
 #include <cstdbool>
+#include <cstddef>
 #include <cstdint>
 
+class NTPCaptureSink;
+
 /**
  * @brief Low level layer of message exchange between client and server.
  * 
@@ -31,6 +41,8 @@ class NTPMessageTransport
 {
 
 public:
+    virtual ~NTPMessageTransport() = default;
+
     // The timestamp data are a subset of the of the definitions of the reference design
     // given in https://github.com/ntp-project/ntp/blob/master-no-authorname/include/ntp_fp.h .
     // Especially I do not like to reimplement what they themself call "a big hack" that helps
@@ -65,10 +77,27 @@ public:
         // Omitted by intention - trailing data will not be handled.
     };
 
+    /// Size of the NTP header on the wire.  The packet is sent and received as it is, so
+    /// its memory layout must match the wire format without any padding.
+    static constexpr size_t NTP_PACKET_SIZE = 48U;
+    static_assert(sizeof(ntp_packet) == NTP_PACKET_SIZE, "ntp_packet does not match the NTP wire format");
+    static_assert(offsetof(ntp_packet, reftime) == 16U, "ntp_packet has unexpected padding");
+
     // Transport methods
     bool packetExchange(struct ntp_packet *packet, unsigned long timeout);
+    NTPStatus exchange(struct ntp_packet *packet, unsigned long timeout);
+    bool beginExchange(struct ntp_packet *packet);
+    bool pollExchange(struct ntp_packet *packet);
+    void cancelExchange();
     String serverName() const;
     void setServerName(const char *ntp_server_name);
+    IPAddress serverAddress() const;
+    bool setLocalPort(uint16_t port);
+    void setEphemeralPorts(unsigned int exchanges_per_port = 1U);
+    virtual uint16_t localPort() const;
+    unsigned long txMicros() const;
+    unsigned long rxMicros() const;
+    void setCaptureSink(NTPCaptureSink *sink);
 
     // Timestamp handling
     static uint16_t getSeconds(const tstamp32_t &ts);
@@ -80,19 +109,54 @@ public:
     static bool printKissCode(const char *code);
 
 protected:
-    // Q.v. http://www.iana.org/assignments/port-numbers
-    static constexpr uint16_t NTP_SERVER_PORT = 123U; ///< Server UDP port given by IANA.
-    static constexpr uint16_t UDP_LOCAL_PORT = 8123U; ///< Client UDP port after my fancy.
+    static constexpr uint16_t NTP_SERVER_PORT = NTPUdpSocket::NTP_SERVER_PORT;
+    static constexpr uint16_t DEFAULT_LOCAL_PORT = NTPUdpSocket::DEFAULT_LOCAL_PORT;
     // Taken from the RFC 5905 reference implementation 'A.1.1.'
     // q.v. https://tools.ietf.org/html/rfc5905#appendix-A.1.1
     static constexpr double FRIC = 65536.;      ///< 2^16 as a double
     static constexpr double FRAC = 4294967296.; ///< 2^32 as a double
 
-    bool net_provider();
-    bool send_server_request(struct ntp_packet *ntp_request);
+    // The network I/O can be replaced by derived transports, q.v. NTPReplayTransport.
+    virtual bool net_provider();
+    bool resolve_server();
+    virtual bool send_server_request(struct ntp_packet *ntp_request);
+    virtual bool poll_server_reply(struct ntp_packet *ntp_reply);
     bool receive_server_reply(struct ntp_packet *ntp_reply, unsigned long timeout);
+    void capture_exchange(const struct ntp_packet &reply);
+    WiFiUDP &datagram();
+    virtual void close_sockets();
+    uint16_t local_port_setting() const;
+
+    unsigned long _tx_micros = 0; ///< micros() when the last request has been sent.
+    unsigned long _rx_micros = 0; ///< micros() when the last reply has been seen.
 
 private:
-    String _server_name_str;
-    WiFiUDP _datagram;
+    NTPUdpSocket _udp;           ///< Server, socket and ports.
+    NTPCaptureSink *_capture_sink = nullptr;
+    struct ntp_packet _request;  ///< Copy of the pending request for the capture sink.
+    bool _exchange_pending = false;
+};
+
+/**
+ * @brief Receiver of every successful request/reply pair of a NTPMessageTransport.
+ * 
+ * Attach an implementation with NTPMessageTransport::setCaptureSink() to record exchanges for
+ * offline analysis, q.v. NTPPcapWriter.
+ */
+class NTPCaptureSink
+{
+public:
+    virtual ~NTPCaptureSink() = default;
+
+    /**
+     * @brief Called after a reply has been received.
+     * 
+     * @param request The request as it has been sent.  Its Transmit Timestamp is the local T1.
+     * @param reply The reply as it has been received.
+     * @param server Address of the server.
+     * @param local_port Local UDP port of the exchange.
+     * @param t4 Local arrival time of the reply (T4) on the time scale of T1.
+     */
+    virtual void capture(const NTPMessageTransport::ntp_packet &request, const NTPMessageTransport::ntp_packet &reply,
+                         const IPAddress &server, uint16_t local_port, NTPMessageTransport::tstamp64_t t4) = 0;
 };
@@ -0,0 +1,353 @@
+/**
+ * @file NTPClock.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "NTPClock.h"
+#include <Arduino.h>
+#include <cmath>
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+static std::atomic<const NTPTimeBase *> bound_time_base{nullptr};
+
+/**
+ * @brief The local microsecond counter as 64 bit value that does not wrap.
+ */
+int64_t NTPTimeBase::localMicros()
+{
+#if defined(ESP32)
+    return esp_timer_get_time();
+#elif defined(ESP8266)
+    return (int64_t)micros64();
+#else
+    return (int64_t)micros();
+#endif
+}
+
+/**
+ * @brief Tells whether there has been a sample yet.
+ */
+bool NTPTimeBase::valid() const
+{
+    return load().valid;
+}
+
+/**
+ * @brief The synchronized time now.
+ */
+NTPTimestamp NTPTimeBase::now() const
+{
+    return at(localMicros());
+}
+
+/**
+ * @brief The synchronized time at the given value of the local counter.
+ */
+NTPTimestamp NTPTimeBase::at(int64_t local_us) const
+{
+    return project(load(), local_us);
+}
+
+/**
+ * @brief Estimated frequency correction of the local counter in parts per billion.
+ */
+int32_t NTPTimeBase::frequency() const
+{
+    return load().freq_ppb;
+}
+
+/**
+ * @brief Observed Allan deviation of the local oscillator at the poll interval, 0 until known.
+ */
+float NTPTimeBase::stability() const
+{
+    base_state state = load();
+    return (state.y_count >= MIN_STABILITY_SAMPLES) ? sqrtf(state.allan_var) : 0.0f;
+}
+
+/**
+ * @brief The synchronized time now and how far it can be off.
+ * 
+ * This needs no network, so ask it to decide whether the time is still good enough.
+ */
+NTPTimeBase::time_estimate NTPTimeBase::estimate() const
+{
+    return estimateAt(localMicros());
+}
+
+/**
+ * @brief The synchronized time at the given value of the local counter and its error bound.
+ */
+NTPTimeBase::time_estimate NTPTimeBase::estimateAt(int64_t local_us) const
+{
+    base_state state = load();
+    time_estimate estimate;
+    estimate.time = project(state, local_us);
+    if (!state.valid)
+    {
+        estimate.max_error = INFINITY;
+        return estimate;
+    }
+    int64_t elapsed_us = local_us - state.local_us;
+    if (elapsed_us < 0)
+        elapsed_us = -elapsed_us;
+    estimate.max_error = state.max_error + wander(state) * (elapsed_us / 1e6f);
+    return estimate;
+}
+
+/**
+ * @brief The steady timeline now in nanoseconds.
+ */
+int64_t NTPTimeBase::steadyNanos() const
+{
+    base_state state = load();
+    return project_steady(state, localMicros());
+}
+
+/**
+ * @brief The steady timeline at the given value of the local counter.
+ */
+int64_t NTPTimeBase::steadyAt(int64_t local_us) const
+{
+    return project_steady(load(), local_us);
+}
+
+/**
+ * @brief Takes a new sample.
+ * 
+ * @param time The synchronized time measured at local_us.
+ * @param local_us The value of localMicros() belonging to time.
+ * @param max_error Error bound of time in seconds, e.g. the root distance of the sample.
+ */
+void NTPTimeBase::update(NTPTimestamp time, int64_t local_us, float max_error)
+{
+    base_state state = _state;
+    // Change the steady rate at this very moment, so the timeline stays continuous for
+    // everybody who read it before.
+    int64_t now_us = localMicros();
+    int64_t steady_now_ns = project_steady(state, now_us);
+    int64_t slew_us = 0;
+    if (state.valid)
+    {
+        int64_t interval_us = local_us - state.local_us;
+        // Samples out of order are of no use.
+        if (interval_us < 0)
+            return;
+        // The difference between measured and predicted time has accumulated since the last
+        // update.  A quarter of it goes into the frequency, which damps the measurement noise.
+        // Steps beyond the step threshold are no frequency error but a time jump.
+        int64_t error_ns = (time - project(state, local_us)).toChrono().count();
+        if ((error_ns < STEP_THRESHOLD_NS) && (error_ns > -STEP_THRESHOLD_NS))
+        {
+            if (interval_us >= MIN_FREQUENCY_INTERVAL_US)
+            {
+                // The fractional frequency of the local counter over this interval.  Half the mean
+                // square of the differences between successive ones is the Allan variance at the
+                // poll interval; an exponential average keeps it without a history.
+                float y = (state.freq_ppb + (float)error_ns * 1e6f / interval_us) * 1e-9f;
+                if (state.y_count > 0)
+                {
+                    float dy = y - state.last_y;
+                    if (state.y_count == 1)
+                        state.allan_var = 0.5f * dy * dy;
+                    else
+                        state.allan_var += (0.5f * dy * dy - state.allan_var) / 8.0f;
+                }
+                state.last_y = y;
+                if (state.y_count < UINT8_MAX)
+                    state.y_count++;
+                int64_t freq_ppb = state.freq_ppb + error_ns * 1000000 / interval_us / 4;
+                if (freq_ppb > MAX_FREQUENCY_PPB)
+                    freq_ppb = MAX_FREQUENCY_PPB;
+                if (freq_ppb < -MAX_FREQUENCY_PPB)
+                    freq_ppb = -MAX_FREQUENCY_PPB;
+                state.freq_ppb = (int32_t)freq_ppb;
+            }
+            // The steady timeline is slewed until the next sample, which is expected after the
+            // same interval again.
+            slew_us = (interval_us > MIN_FREQUENCY_INTERVAL_US) ? interval_us : MIN_FREQUENCY_INTERVAL_US;
+        }
+        else
+        {
+            // After a step the frequency measurements start over.
+            state.y_count = 0;
+        }
+    }
+    state.time = time;
+    state.local_us = local_us;
+    state.max_error = (max_error > 0.0f) ? max_error : 0.0f;
+    state.valid = true;
+
+    state.steady_ns = steady_now_ns;
+    state.steady_local_us = now_us;
+    state.steady_ppb = state.freq_ppb;
+    state.steady_slew_end_us = now_us;
+    // The gap between the steady timeline and the new time includes what an earlier slew has not
+    // worked off yet.  The first sample and a step of the time take it as it is, else it is
+    // worked off within slew_us, or slower if the slew is at its limit.
+    int64_t gap_ns = (project(state, now_us) - state.steady_origin).toChrono().count() - steady_now_ns;
+    if ((slew_us == 0) || (gap_ns >= STEP_THRESHOLD_NS) || (gap_ns <= -STEP_THRESHOLD_NS))
+    {
+        state.steady_origin = project(state, now_us) - NTPDuration::fromChrono(std::chrono::nanoseconds(steady_now_ns));
+    }
+    else
+    {
+        int64_t slew_ppb = gap_ns * 1000000 / slew_us;
+        if ((slew_ppb > MAX_SLEW_PPB) || (slew_ppb < -MAX_SLEW_PPB))
+        {
+            slew_ppb = (slew_ppb > 0) ? MAX_SLEW_PPB : -MAX_SLEW_PPB;
+            slew_us = gap_ns * 1000000 / slew_ppb;
+        }
+        state.steady_ppb += (int32_t)slew_ppb;
+        state.steady_slew_end_us = now_us + slew_us;
+    }
+    store(state);
+}
+
+/**
+ * @brief Forgets time and frequency.  The steady timeline continues at the rate of the local counter.
+ */
+void NTPTimeBase::reset()
+{
+    base_state state = _state;
+    int64_t now_us = localMicros();
+    state.steady_ns = project_steady(state, now_us);
+    state.steady_local_us = now_us;
+    state.steady_ppb = 0;
+    state.steady_slew_end_us = now_us;
+    state.time = NTPTimestamp();
+    state.local_us = 0;
+    state.freq_ppb = 0;
+    state.max_error = 0.0f;
+    state.last_y = 0.0f;
+    state.allan_var = 0.0f;
+    state.y_count = 0;
+    state.valid = false;
+    store(state);
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+NTPTimestamp NTPTimeBase::project(const base_state &state, int64_t local_us)
+{
+    int64_t elapsed_us = local_us - state.local_us;
+    int64_t correction_ns = elapsed_us * state.freq_ppb / 1000000;
+    return state.time + NTPDuration::fromMicros(elapsed_us) + NTPDuration::fromChrono(std::chrono::nanoseconds(correction_ns));
+}
+
+/**
+ * @brief The steady timeline at local_us: steady_ppb while slewing, freq_ppb after that.
+ */
+int64_t NTPTimeBase::project_steady(const base_state &state, int64_t local_us)
+{
+    int64_t elapsed_us = local_us - state.steady_local_us;
+    int64_t slewing_us = state.steady_slew_end_us - state.steady_local_us;
+    if (elapsed_us <= slewing_us)
+        return state.steady_ns + elapsed_us * 1000 + elapsed_us * state.steady_ppb / 1000000;
+    int64_t after_us = elapsed_us - slewing_us;
+    return state.steady_ns + elapsed_us * 1000 + slewing_us * state.steady_ppb / 1000000 +
+           after_us * state.freq_ppb / 1000000;
+}
+
+/**
+ * @brief How fast the error bound grows in seconds per second.
+ */
+float NTPTimeBase::wander(const base_state &state)
+{
+    if (state.y_count < MIN_STABILITY_SAMPLES)
+        return PHI;
+    float wander = 3.0f * sqrtf(state.allan_var);
+    return (wander > MIN_WANDER) ? wander : MIN_WANDER;
+}
+
+void NTPTimeBase::store(const base_state &state)
+{
+    _sequence.fetch_add(1, std::memory_order_acq_rel);
+    std::atomic_thread_fence(std::memory_order_release);
+    _state = state;
+    _sequence.fetch_add(1, std::memory_order_release);
+}
+
+NTPTimeBase::base_state NTPTimeBase::load() const
+{
+    base_state state;
+    uint32_t sequence;
+    do
+    {
+        sequence = _sequence.load(std::memory_order_acquire);
+        state = _state;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1U) || sequence != _sequence.load(std::memory_order_relaxed));
+    return state;
+}
+
+//********************************************************************
+// ntp_clock
+//********************************************************************
+
+ntp_clock::time_point ntp_clock::now() noexcept
+{
+    const NTPTimeBase *base = bound_time_base.load(std::memory_order_acquire);
+    if ((base == nullptr) || !base->valid())
+        return time_point();
+    return time_point(base->now().toUnix());
+}
+
+/**
+ * @brief Selects the time base now() reads from.  nullptr unbinds.
+ */
+void ntp_clock::bind(const NTPTimeBase *base) noexcept
+{
+    bound_time_base.store(base, std::memory_order_release);
+}
+
+/**
+ * @brief Tells whether now() returns synchronized time.
+ */
+bool ntp_clock::synchronized() noexcept
+{
+    const NTPTimeBase *base = bound_time_base.load(std::memory_order_acquire);
+    return (base != nullptr) && base->valid();
+}
+
+std::time_t ntp_clock::to_time_t(const time_point &t) noexcept
+{
+    return (std::time_t)std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+}
+
+ntp_clock::time_point ntp_clock::from_time_t(std::time_t t) noexcept
+{
+    return time_point(std::chrono::seconds(t));
+}
+
+std::chrono::system_clock::time_point ntp_clock::to_sys(const time_point &t) noexcept
+{
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(t.time_since_epoch()));
+}
+
+ntp_clock::time_point ntp_clock::from_sys(const std::chrono::system_clock::time_point &t) noexcept
+{
+    return time_point(std::chrono::duration_cast<duration>(t.time_since_epoch()));
+}
+
+//********************************************************************
+// ntp_steady_clock
+//********************************************************************
+
+ntp_steady_clock::time_point ntp_steady_clock::now() noexcept
+{
+    const NTPTimeBase *base = bound_time_base.load(std::memory_order_acquire);
+    if (base == nullptr)
+        return time_point(std::chrono::microseconds(NTPTimeBase::localMicros()));
+    return time_point(duration(base->steadyNanos()));
+}
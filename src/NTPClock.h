@@ -0,0 +1,159 @@
+/**
+ * @file NTPClock.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "NTPTimestamp.h"
+#include <atomic>
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+#include <ctime>
+
+/**
+ * @brief Maps the local microsecond counter onto synchronized time.
+ * 
+ * Reading the time is one counter read plus a multiply-add:
+ * 
+ *     time = base_time + (local_us - base_us) * (1 + frequency)
+ * 
+ * Every sample moves the base onto the measured time.  The frequency error of the local
+ * oscillator is estimated from how far the time had drifted since the previous sample
+ * (frequency-locked loop), so the time stays good between samples.
+ * 
+ * Besides that it runs a steady timeline for measuring intervals.  It starts as the local counter
+ * and never steps: at every sample a slew is added to the frequency correction, which works off
+ * the gap between the steady timeline and the new time within one poll interval.  After that the
+ * timeline runs at the frequency correction alone, so holdover does not slew on.  The rate
+ * differs at most MAX_STEADY_RATE_PPB from the local counter, so it is monotonic and its rate
+ * changes are bounded.  After a step of the time the gap is taken as it is.
+ * 
+ * When samples stop coming (holdover) the time runs on with the last frequency estimate.
+ * estimate() tells how far it can be off: the error bound of the last sample plus three times
+ * the observed Allan deviation of the oscillator per elapsed second.  Until there are enough
+ * samples to observe it, the frequency tolerance PHI is taken instead.
+ * 
+ * Reads are safe from any task while the client updates the base.
+ */
+class NTPTimeBase
+{
+public:
+    static constexpr int32_t MAX_FREQUENCY_PPB = 500000;             ///< 500 ppm as RFC 5905 allows it
+    static constexpr int32_t MAX_SLEW_PPB = 500000;                  ///< 500 ppm like adjtime() slews
+    static constexpr int32_t MAX_STEADY_RATE_PPB = MAX_FREQUENCY_PPB + MAX_SLEW_PPB;
+    static constexpr int64_t MIN_FREQUENCY_INTERVAL_US = 16000000LL; ///< Shorter intervals are too noisy
+    static constexpr int64_t STEP_THRESHOLD_NS = 128000000LL;        ///< 128 ms as RFC 5905 A.1.1 STEPT
+    static constexpr float PHI = 15e-6f;                             ///< frequency tolerance (15 ppm)
+    static constexpr float MIN_WANDER = 1e-7f;                       ///< floor of the error growth (0.1 ppm)
+    static constexpr uint8_t MIN_STABILITY_SAMPLES = 4;              ///< before the Allan deviation is used
+    /// Interim time counted on from with localMicros() before the first sample (2021-11-18Z14:01:05).
+    static constexpr NTPTimestamp INTERIM_EPOCH = NTPTimestamp::fromUnix(std::chrono::seconds(1637244065));
+
+    /**
+     * @brief The synchronized time together with its error bound.
+     */
+    struct time_estimate
+    {
+        NTPTimestamp time;
+        float max_error;  ///< the time is right within +- this many seconds, infinite if unsynchronized
+    };
+
+    static int64_t localMicros();
+
+    bool valid() const;
+    NTPTimestamp now() const;
+    NTPTimestamp at(int64_t local_us) const;
+    int32_t frequency() const;
+    float stability() const;
+    time_estimate estimate() const;
+    time_estimate estimateAt(int64_t local_us) const;
+    int64_t steadyNanos() const;
+    int64_t steadyAt(int64_t local_us) const;
+    void update(NTPTimestamp time, int64_t local_us, float max_error = 0.0f);
+    void reset();
+
+protected:
+    struct base_state
+    {
+        NTPTimestamp time;  ///< synchronized time at local_us
+        int64_t local_us;   ///< local counter at the last update
+        int32_t freq_ppb;   ///< frequency correction of the local counter
+        bool valid;
+        int64_t steady_ns;        ///< steady timeline at steady_local_us
+        int64_t steady_local_us;  ///< local counter when the steady rate has been set
+        int32_t steady_ppb;       ///< rate of the steady timeline against the local counter while slewing
+        int64_t steady_slew_end_us; ///< local counter when the slew is done, freq_ppb from then on
+        NTPTimestamp steady_origin; ///< synchronized time minus the steady timeline it is slewed to
+        float max_error;          ///< error bound of the sample at local_us
+        float last_y;             ///< last measured fractional frequency of the local counter
+        float allan_var;          ///< smoothed Allan variance at the poll interval
+        uint8_t y_count;          ///< frequency measurements taken, saturating
+    };
+    static NTPTimestamp project(const base_state &state, int64_t local_us);
+    static int64_t project_steady(const base_state &state, int64_t local_us);
+    static float wander(const base_state &state);
+    void store(const base_state &state);
+    base_state load() const;
+
+private:
+    // Seqlock: odd while an update is in progress.
+    std::atomic<uint32_t> _sequence{0};
+    base_state _state = {NTPTimestamp(), 0, 0, false, 0, 0, 0, 0, NTPTimestamp(), 0.0f, 0.0f, 0.0f, 0};
+};
+
+/**
+ * @brief A std::chrono clock showing the synchronized time of a NTPTimeBase.
+ * 
+ * Bind it to the time base of your client once:
+ * 
+ *     ntp_clock::bind(&client.timeBase());
+ *     ntp_clock::time_point t = ntp_clock::now();
+ * 
+ * Time points count nanoseconds since 1. Jan. 1970Z00:00:00 like std::chrono::system_clock, so
+ * to_sys() and std::chrono formatting work.  As long as there is no valid time base now() returns
+ * the epoch.
+ */
+struct ntp_clock
+{
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<ntp_clock>;
+    static constexpr bool is_steady = false;
+
+    static time_point now() noexcept;
+    static void bind(const NTPTimeBase *base) noexcept;
+    static bool synchronized() noexcept;
+
+    static std::time_t to_time_t(const time_point &t) noexcept;
+    static time_point from_time_t(std::time_t t) noexcept;
+    static std::chrono::system_clock::time_point to_sys(const time_point &t) noexcept;
+    static time_point from_sys(const std::chrono::system_clock::time_point &t) noexcept;
+};
+
+/**
+ * @brief A std::chrono steady clock running on the steady timeline of a NTPTimeBase.
+ * 
+ * Use it for timers and rate limits.  It has the frequency corrections of the synchronized clock
+ * but never jumps when that steps.  It reads the time base given to ntp_clock::bind().  Without
+ * one it shows the local counter, which is where the steady timeline starts, so binding does not
+ * make it jump either.
+ */
+struct ntp_steady_clock
+{
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<ntp_steady_clock>;
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept;
+};
@@ -0,0 +1,197 @@
+/**
+ * @file NTPEngine.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "NTPEngine.h"
+#include <cerrno>
+#include <cstring>
+
+/**
+ * @brief Writes a client request into the buffer.
+ * 
+ * @param t1 Transmit Timestamp of the request.  Make it differ between requests, q.v. the
+ * "suggested check 3." of RFC 4330 "5. SNTP Client Operations".
+ * @param buffer Receives the request.
+ * @param size Size of buffer, at least PACKET_SIZE.
+ * @param[out] request Receives what is needed to check the reply.
+ * @return Number of bytes written, 0 if the buffer is too small or an argument is missing.
+ */
+size_t NTPEngine::buildRequest(NTPTimestamp t1, uint8_t *buffer, size_t size, ntp_request *request)
+{
+    if ((buffer == nullptr) || (request == nullptr) || (size < PACKET_SIZE))
+        return 0;
+    // I am a client.  This is my request to my server: the template with T1 stored into it.
+    memcpy(buffer, REQUEST_TEMPLATE, PACKET_SIZE);
+    request->xmt = t1.encode();
+    memcpy(buffer + OFFSET_XMT, &request->xmt, sizeof(request->xmt));
+    return PACKET_SIZE;
+}
+
+/**
+ * @brief Checks a reply like RFC 4330 '5. SNTP Client Operations' demands it.
+ * 
+ * @param request The request the reply should belong to.
+ * @param reply The bytes received.
+ * @param length Number of bytes received.
+ * @param[out] result Receives the header fields and the error code.
+ * @return true if the reply is good, false if not.  result->error tells why.
+ */
+bool NTPEngine::checkReply(const ntp_request &request, const uint8_t *reply, size_t length, ntp_result *result)
+{
+    if (result == nullptr)
+        return false;
+    *result = ntp_result();
+    result->t1 = NTPTimestamp::decode(request.xmt);
+    if ((reply == nullptr) || (length < PACKET_SIZE))
+    {
+        // The datagram is too small to be valid.
+        result->error = EPROTONOSUPPORT;
+        return false;
+    }
+    read_header(reply, result);
+    uint8_t li_vn_mode = reply[OFFSET_LI_VN_MODE];
+
+    // The expected answer should be sent from a server.
+    constexpr uint8_t MODE_MASK = 0b00000'111;
+    if ((li_vn_mode & MODE_MASK) != MODE_SERVER)
+    {
+        // Operation not supported.
+        result->error = EOPNOTSUPP;
+        return false;
+    }
+    // The answer protocol version must be identical to the protocol version we used before.
+    constexpr uint8_t PROTOCOL_MASK = 0b00'111'000;
+    if ((li_vn_mode & PROTOCOL_MASK) != NTP_VERSION_4)
+    {
+        // Protocol not supported.
+        result->error = EPROTONOSUPPORT;
+        return false;
+    }
+    // There are no valid data if the server clock is not synchronized.
+    constexpr uint8_t LEAP_MASK = 0b11'000000;
+    constexpr uint8_t LEAP_ALARM_CONDITION = 0b11'000000;
+    if ((li_vn_mode & LEAP_MASK) == LEAP_ALARM_CONDITION)
+    {
+        // No data available.
+        result->error = ENODATA;
+        return false;
+    }
+    // Evaluate stratum ranges
+    if (result->stratum > 15)
+    {
+        // Stratum values from 16-255 are reserved and must not be handled.
+        // Protocol family not supported.
+        result->error = EPFNOSUPPORT;
+        return false;
+    }
+    if (result->stratum == 0)
+    {
+        // Q.v. "RFC 4330, 6. SNTP Server Operations": "clients should discard the server message".
+        // This is a "kiss-o'-death message".  The code is held by the four octets of the refid.
+        memcpy(result->kiss_code, reply + OFFSET_REFID, 4);
+        result->kiss_code[4] = '\0';
+        // Resource temporarily unavailable.
+        result->error = EAGAIN;
+        return false;
+    }
+    // Check timestamps.  The Originate Timestamp from the server should
+    // be a copy of the old Transmit Timestamp from the client.
+    if (load64(reply + OFFSET_ORG) != request.xmt)
+    {
+        // Time stamps do not match.  Bad message.
+        result->error = EBADMSG;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Computes offset and delay of a checked reply and reads its header fields.
+ * 
+ * @param request The request the reply belongs to.
+ * @param reply The reply, at least PACKET_SIZE bytes.
+ * @param t4 Local arrival time of the reply on the time scale of T1.
+ * @param[out] result Receives the timestamps, offset and delay.
+ */
+void NTPEngine::takeSample(const ntp_request &request, const uint8_t *reply, NTPTimestamp t4, ntp_result *result)
+{
+    read_header(reply, result);
+    result->t1 = NTPTimestamp::decode(request.xmt);
+    on_wire(reply, t4, result);
+}
+
+/**
+ * @brief checkReply() and takeSample() in one.
+ * 
+ * @return true if the reply is good and the sample has been taken, false if not.  result->error tells why.
+ */
+bool NTPEngine::processReply(const ntp_request &request, const uint8_t *reply, size_t length, NTPTimestamp t4,
+                             ntp_result *result)
+{
+    if (checkReply(request, reply, length, result) == false)
+        return false;
+    // checkReply() has read the header and T1 already.
+    on_wire(reply, t4, result);
+    return true;
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+/**
+ * @brief Computes offset and delay from T1 in result, the reply and T4.
+ */
+void NTPEngine::on_wire(const uint8_t *reply, NTPTimestamp t4, ntp_result *result)
+{
+    // On-wire protocol needs four timestamps called T1, T2, T3, T4.  You can find the On-Wire algorithm
+    // in RFC 4330, 5. SNTP Client Operations or at https://www.eecis.udel.edu/~mills/onwire.html.
+    // The computation is done on 32.32 fixed point values.  This is exact down to 2^-32 s, does not
+    // depend on a 64 bit double (Arduino AVR claims double but just uses 32 bit) and differences of
+    // timestamps stay right across the era boundary in 2036.
+    result->t2 = NTPTimestamp::decode(load64(reply + OFFSET_REC)); // Receive Timestamp measured by the server
+    result->t3 = NTPTimestamp::decode(load64(reply + OFFSET_XMT)); // Transmit Timestamp when the server sent its message
+    result->t4 = t4;                                               // Destination Timestamp
+    result->offset = ((result->t2 - result->t1) + (result->t3 - result->t4)).halve();
+    result->delay = (result->t4 - result->t1) - (result->t3 - result->t2);
+}
+
+/**
+ * @brief Copies the header fields of the reply into the result.
+ */
+void NTPEngine::read_header(const uint8_t *reply, ntp_result *result)
+{
+    result->leap = reply[OFFSET_LI_VN_MODE] >> 6;
+    result->stratum = reply[OFFSET_STRATUM];
+    result->precision = (int8_t)reply[OFFSET_PRECISION];
+    memcpy(&result->refid, reply + OFFSET_REFID, sizeof(result->refid));
+    result->rootdelay = NTPShort::decode(load32(reply + OFFSET_ROOTDELAY));
+    result->rootdisp = NTPShort::decode(load32(reply + OFFSET_ROOTDISP));
+}
+
+/**
+ * @brief Loads 4 bytes as they are, the buffer may be unaligned.
+ */
+uint32_t NTPEngine::load32(const uint8_t *bytes)
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Loads 8 bytes as they are, the buffer may be unaligned.
+ */
+uint64_t NTPEngine::load64(const uint8_t *bytes)
+{
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file NTPEngine.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "NTPTimestamp.h"
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The SNTP client protocol without any I/O.
+ * 
+ * It knows nothing of sockets, clocks, delays or Serial.  The caller
+ * 1. writes a request into a buffer of its own with buildRequest(), keeping the ntp_request,
+ * 2. sends it and stamps send and arrival on its local clock as it likes, and
+ * 3. passes the reply bytes and the local arrival time T4 to processReply().
+ * 
+ * So every transport can drive it, a batch of replies is just a loop, and it can be measured
+ * on its own.  Errors are given as errno codes in the result, errno itself is not touched.
+ * 
+ * \sa NTPClient which drives it with a NTPMessageTransport.
+ */
+class NTPEngine
+{
+public:
+    static constexpr size_t PACKET_SIZE = 48U; ///< NTP header on the wire
+    // Doing this like described in RFC 4330 '4. Message Format' and '5. SNTP Client Operations'.
+    static constexpr uint8_t LEAP_NO_WARNING = 0b00'000000; ///< Clients do not announce leap seconds
+    static constexpr uint8_t NTP_VERSION_4 = 0b00'100'000;  ///< I want to use NTP protocol version 4
+    static constexpr uint8_t MODE_CLIENT = 0b00000'011;     ///< I am a client
+    static constexpr uint8_t MODE_SERVER = 0b00000'100;
+
+    /**
+     * @brief What has to be kept of a request to check its reply.
+     */
+    struct ntp_request
+    {
+        uint64_t xmt; ///< Transmit Timestamp as sent, in wire format
+    };
+
+    /**
+     * @brief Outcome of a reply.  Header fields are filled in as far as the checks got.
+     */
+    struct ntp_result
+    {
+        int error;             ///< 0 if the reply is good, else an errno code telling why not
+        char kiss_code[5];     ///< Kiss-o'-Death code if error is EAGAIN, else empty
+        uint8_t leap;          ///< leap indicator of the server (0..3)
+        uint8_t stratum;
+        int8_t precision;
+        uint32_t refid;        ///< as received (network byte order)
+        NTPShort rootdelay;
+        NTPShort rootdisp;
+        NTPTimestamp t1;       ///< Transmit Timestamp of the request
+        NTPTimestamp t2;       ///< Receive Timestamp of the server
+        NTPTimestamp t3;       ///< Transmit Timestamp of the server
+        NTPTimestamp t4;       ///< local arrival time of the reply
+        NTPDuration offset;    ///< clock offset of the server against the local clock
+        NTPDuration delay;     ///< round-trip delay without the time spent in the server
+    };
+
+    static size_t buildRequest(NTPTimestamp t1, uint8_t *buffer, size_t size, ntp_request *request);
+    static bool checkReply(const ntp_request &request, const uint8_t *reply, size_t length, ntp_result *result);
+    static void takeSample(const ntp_request &request, const uint8_t *reply, NTPTimestamp t4, ntp_result *result);
+    static bool processReply(const ntp_request &request, const uint8_t *reply, size_t length, NTPTimestamp t4,
+                             ntp_result *result);
+
+    // Offsets of the fields on the wire, q.v. RFC 5905, 7.3 Packet Header Variables, Fig. 8.
+    static constexpr size_t OFFSET_LI_VN_MODE = 0U;
+    static constexpr size_t OFFSET_STRATUM = 1U;
+    static constexpr size_t OFFSET_PRECISION = 3U;
+    static constexpr size_t OFFSET_ROOTDELAY = 4U;
+    static constexpr size_t OFFSET_ROOTDISP = 8U;
+    static constexpr size_t OFFSET_REFID = 12U;
+    static constexpr size_t OFFSET_ORG = 24U;
+    static constexpr size_t OFFSET_REC = 32U;
+    static constexpr size_t OFFSET_XMT = 40U;
+
+protected:
+    /// Every request looks the same apart from its Transmit Timestamp: everything but the first
+    /// octet is zero / NIL.  So it is built at compile time and copied.
+    static constexpr uint8_t REQUEST_TEMPLATE[PACKET_SIZE] = {LEAP_NO_WARNING | NTP_VERSION_4 | MODE_CLIENT};
+
+    static void read_header(const uint8_t *reply, ntp_result *result);
+    static void on_wire(const uint8_t *reply, NTPTimestamp t4, ntp_result *result);
+    static uint32_t load32(const uint8_t *bytes);
+    static uint64_t load64(const uint8_t *bytes);
+};
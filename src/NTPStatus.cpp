@@ -0,0 +1,153 @@
+/**
+ * @file NTPStatus.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "NTPStatus.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * @brief Status for an errno code, 0 gives OK.
+ */
+NTPStatus NTPStatus::fromErrno(int error)
+{
+    NTPStatus status;
+    status._error = error;
+    switch (error)
+    {
+    case 0:
+        status._code = OK;
+        break;
+    case EINPROGRESS:
+        status._code = IN_PROGRESS;
+        break;
+    case EINVAL:
+        status._code = INVALID_ARGUMENT;
+        break;
+    case EALREADY:
+        status._code = BUSY;
+        break;
+    case ETIMEDOUT:
+        status._code = TIMEOUT;
+        break;
+    case EAGAIN:
+        status._code = KISS_OF_DEATH;
+        break;
+    case ENODATA:
+        status._code = UNSYNCHRONIZED;
+        break;
+    case EBADMSG:
+        status._code = BAD_MESSAGE;
+        break;
+    case EOPNOTSUPP:
+    case EPROTONOSUPPORT:
+    case EPFNOSUPPORT:
+        status._code = PROTOCOL;
+        break;
+    case ERANGE:
+        status._code = FILTERED;
+        break;
+    default:
+        status._code = NETWORK;
+        break;
+    }
+    return status;
+}
+
+/**
+ * @brief Status of a Kiss-o'-Death reply.
+ * 
+ * @param kiss_code The four ASCII characters of the reference id, q.v. RFC 5905, 7.4.
+ */
+NTPStatus NTPStatus::kissOfDeath(const char *kiss_code)
+{
+    NTPStatus status = fromErrno(EAGAIN);
+    if (kiss_code != nullptr)
+        strncpy(status._kiss_code, kiss_code, sizeof(status._kiss_code) - 1);
+    return status;
+}
+
+/**
+ * @brief Hands the status over to the calls reporting by errno.
+ * 
+ * @return true if OK.  Else false and errno is set, like those calls return.
+ */
+bool NTPStatus::toErrno() const
+{
+    if (_code == OK)
+        return true;
+    errno = _error;
+    return false;
+}
+
+/**
+ * @brief Writes a line like "kiss-o'-death RATE" or "timeout: Connection timed out".
+ * 
+ * @param buffer Receives the text, always terminated if size is not 0.
+ * @param size Size of buffer.  FORMAT_SIZE is always enough.
+ * @return Length of the full text like snprintf() gives it.
+ */
+size_t NTPStatus::format(char *buffer, size_t size) const
+{
+    int length;
+    if (_code == OK)
+        length = snprintf(buffer, size, "%s", codeName(_code));
+    else if (_code == KISS_OF_DEATH)
+        length = snprintf(buffer, size, "%s %s", codeName(_code), _kiss_code);
+    else
+        length = snprintf(buffer, size, "%s: %s", codeName(_code), strerror(_error));
+    return length < 0 ? 0 : (size_t)length;
+}
+
+/**
+ * @brief Prints the text of format() without a line break.
+ * 
+ * @return Number of characters printed.
+ */
+size_t NTPStatus::printTo(Print &out) const
+{
+    char text[FORMAT_SIZE];
+    format(text, sizeof(text));
+    return out.print(text);
+}
+
+/**
+ * @brief Label of a status code.
+ */
+const char *NTPStatus::codeName(status_code code)
+{
+    switch (code)
+    {
+    case OK:
+        return "ok";
+    case IN_PROGRESS:
+        return "in progress";
+    case INVALID_ARGUMENT:
+        return "invalid argument";
+    case BUSY:
+        return "busy";
+    case TIMEOUT:
+        return "timeout";
+    case KISS_OF_DEATH:
+        return "kiss-o'-death";
+    case UNSYNCHRONIZED:
+        return "unsynchronized";
+    case BAD_MESSAGE:
+        return "bad message";
+    case PROTOCOL:
+        return "protocol";
+    case FILTERED:
+        return "filtered";
+    case NETWORK:
+        return "network";
+    }
+    return "unknown";
+}
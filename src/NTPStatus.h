@@ -0,0 +1,69 @@
+/**
+ * @file NTPStatus.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include <Print.h>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Outcome of one call, returned by value instead of being left in errno.
+ * 
+ * errno is one variable for everybody and lastErrorString() reads it later, so another client
+ * or task may have overwritten it meanwhile.  A status belongs to the call that made it and
+ * carries what errno cannot: the Kiss-o'-Death code of the server.  Formatting writes into a
+ * buffer of the caller or a Print, nothing is allocated.
+ * 
+ * \sa NTPClient::tryQuery(), NTPMessageTransport::exchange()
+ */
+class NTPStatus
+{
+public:
+    /// What went wrong, coarse enough to act upon.
+    enum status_code : uint8_t
+    {
+        OK,
+        IN_PROGRESS,      ///< EINPROGRESS: the reply has not arrived yet
+        INVALID_ARGUMENT, ///< EINVAL
+        BUSY,             ///< EALREADY: another query is pending
+        TIMEOUT,          ///< ETIMEDOUT: the server did not answer in time
+        KISS_OF_DEATH,    ///< EAGAIN: the server told us to go away, q.v. kissCode()
+        UNSYNCHRONIZED,   ///< ENODATA: the server is not synchronized itself
+        BAD_MESSAGE,      ///< EBADMSG: the reply does not belong to our request
+        PROTOCOL,         ///< EPROTONOSUPPORT, EOPNOTSUPP, EPFNOSUPPORT: malformed reply
+        FILTERED,         ///< ERANGE: the sample has been dropped as too far off
+        NETWORK           ///< anything else, usually name resolution or the socket
+    };
+
+    static constexpr size_t FORMAT_SIZE = 80U; ///< Buffer size format() never truncates with.
+
+    NTPStatus() = default;
+    static NTPStatus fromErrno(int error);
+    static NTPStatus kissOfDeath(const char *kiss_code);
+
+    bool ok() const { return _code == OK; }
+    explicit operator bool() const { return ok(); }
+    status_code code() const { return _code; }
+    int error() const { return _error; }
+    const char *kissCode() const { return _kiss_code; }
+    bool toErrno() const;
+
+    size_t format(char *buffer, size_t size) const;
+    size_t printTo(Print &out) const;
+    static const char *codeName(status_code code);
+
+private:
+    status_code _code = OK;
+    int _error = 0;          ///< errno code, 0 if OK
+    char _kiss_code[5] = {}; ///< only if KISS_OF_DEATH
+};
@@ -0,0 +1,189 @@
+/**
+ * @file NTPTimestamp.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdbool>
+#include <cstdint>
+
+// Value types for the NTP data formats of RFC 5905, 6. Data Types.  Unlike the tstamp32_t and
+// tstamp64_t of NTPMessageTransport they are kept in host byte order, so all arithmetic is plain
+// integer arithmetic.  Conversion from and to the wire format is explicit: decode() and encode().
+// Everything is constexpr, so conversions of constants happen at compile time.
+
+namespace ntp_detail
+{
+    constexpr uint64_t wire64(uint64_t value)
+    {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(value);
+#else
+        return value;
+#endif
+    }
+
+    constexpr uint32_t wire32(uint32_t value)
+    {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap32(value);
+#else
+        return value;
+#endif
+    }
+
+    /// Division rounding towards minus infinity.
+    constexpr int64_t floor_div(int64_t a, int64_t b)
+    {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    /// Converts count / units_per_second into 32.32 fixed point, rounded to nearest, without a
+    /// 128 bit intermediate, which the 32 bit targets do not have.
+    constexpr int64_t to_fixed(int64_t count, int64_t units_per_second)
+    {
+        return (int64_t)((uint64_t)floor_div(count, units_per_second) << 32) +
+               (int64_t)((((uint64_t)(count - floor_div(count, units_per_second) * units_per_second) << 32) + (uint64_t)units_per_second / 2) /
+                         (uint64_t)units_per_second);
+    }
+
+    /// Converts 32.32 fixed point into a count of 1 / units_per_second, rounded to nearest.
+    constexpr int64_t from_fixed(int64_t raw, int64_t units_per_second)
+    {
+        return floor_div(raw, 4294967296LL) * units_per_second +
+               (int64_t)((((uint64_t)raw & 0xffffffffULL) * (uint64_t)units_per_second + 0x80000000ULL) >> 32);
+    }
+} // namespace ntp_detail
+
+/**
+ * @brief Signed time difference in 32.32 fixed point seconds.
+ * 
+ * It covers +-68 years with a resolution of 2^-32 s (233 ps).
+ */
+class NTPDuration
+{
+public:
+    constexpr NTPDuration() : _raw(0) {}
+    static constexpr NTPDuration fromRaw(int64_t raw) { return NTPDuration(raw); }
+    static constexpr NTPDuration fromMicros(int64_t us) { return NTPDuration(ntp_detail::to_fixed(us, 1000000)); }
+    static constexpr NTPDuration fromSeconds(double s) { return NTPDuration((int64_t)(s * 4294967296.)); }
+    static constexpr NTPDuration fromChrono(std::chrono::nanoseconds ns) { return NTPDuration(ntp_detail::to_fixed(ns.count(), 1000000000)); }
+
+    constexpr int64_t raw() const { return _raw; }
+    constexpr double toSeconds() const { return _raw / 4294967296.; }
+    constexpr int64_t toMicros() const { return ntp_detail::from_fixed(_raw, 1000000); }
+    constexpr std::chrono::nanoseconds toChrono() const { return std::chrono::nanoseconds(ntp_detail::from_fixed(_raw, 1000000000)); }
+
+    constexpr NTPDuration operator+(NTPDuration other) const { return NTPDuration((int64_t)((uint64_t)_raw + (uint64_t)other._raw)); }
+    constexpr NTPDuration operator-(NTPDuration other) const { return NTPDuration((int64_t)((uint64_t)_raw - (uint64_t)other._raw)); }
+    constexpr NTPDuration operator-() const { return NTPDuration((int64_t)(0 - (uint64_t)_raw)); }
+    constexpr NTPDuration halve() const { return NTPDuration(_raw / 2); }
+    constexpr NTPDuration abs() const { return _raw < 0 ? -*this : *this; }
+
+    constexpr bool operator==(NTPDuration other) const { return _raw == other._raw; }
+    constexpr bool operator!=(NTPDuration other) const { return _raw != other._raw; }
+    constexpr bool operator<(NTPDuration other) const { return _raw < other._raw; }
+    constexpr bool operator<=(NTPDuration other) const { return _raw <= other._raw; }
+    constexpr bool operator>(NTPDuration other) const { return _raw > other._raw; }
+    constexpr bool operator>=(NTPDuration other) const { return _raw >= other._raw; }
+
+private:
+    constexpr explicit NTPDuration(int64_t raw) : _raw(raw) {}
+    int64_t _raw;
+};
+
+/**
+ * @brief NTP Timestamp Format: unsigned 32.32 fixed point seconds since the start of the era.
+ * 
+ * Differences of two timestamps are computed modulo 2^64, so they are right across an era
+ * boundary as long as the timestamps are less than 68 years apart.
+ */
+class NTPTimestamp
+{
+public:
+    constexpr NTPTimestamp() : _raw(0) {}
+    constexpr NTPTimestamp(uint32_t seconds, uint32_t fraction) : _raw((uint64_t)seconds << 32 | fraction) {}
+    static constexpr NTPTimestamp fromRaw(uint64_t raw) { return NTPTimestamp(raw); }
+    /// Converts a timestamp as it is found in a ntp_packet.
+    static constexpr NTPTimestamp decode(uint64_t wire) { return NTPTimestamp(ntp_detail::wire64(wire)); }
+    /// Converts the time since 1. Jan. 1970Z00:00:00 into a timestamp.  From 8. Feb. 2036 on the
+    /// seconds wrap around into era 1.
+    static constexpr NTPTimestamp fromUnix(std::chrono::nanoseconds since_epoch)
+    {
+        return NTPTimestamp((uint64_t)(uint32_t)(ntp_detail::floor_div(since_epoch.count(), 1000000000) + ERA_OFFSET0_1_JAN_1970) << 32) +
+               NTPDuration::fromChrono(std::chrono::nanoseconds(since_epoch.count() - ntp_detail::floor_div(since_epoch.count(), 1000000000) * 1000000000));
+    }
+
+    constexpr uint64_t raw() const { return _raw; }
+    constexpr uint32_t seconds() const { return (uint32_t)(_raw >> 32); }
+    constexpr uint32_t fraction() const { return (uint32_t)_raw; }
+    /// Converts the timestamp into the layout of a ntp_packet.
+    constexpr uint64_t encode() const { return ntp_detail::wire64(_raw); }
+    /// The time since 1. Jan. 1970Z00:00:00.  Timestamps before 1970 are taken as era 1, so this
+    /// is right from 1970 to 2106.
+    constexpr std::chrono::nanoseconds toUnix() const
+    {
+        return std::chrono::nanoseconds((int64_t)(uint32_t)(seconds() - ERA_OFFSET0_1_JAN_1970) * 1000000000 +
+                                        NTPDuration::fromRaw(fraction()).toChrono().count());
+    }
+
+    constexpr NTPTimestamp operator+(NTPDuration d) const { return NTPTimestamp(_raw + (uint64_t)d.raw()); }
+    constexpr NTPTimestamp operator-(NTPDuration d) const { return NTPTimestamp(_raw - (uint64_t)d.raw()); }
+    constexpr NTPDuration operator-(NTPTimestamp other) const { return NTPDuration::fromRaw((int64_t)(_raw - other._raw)); }
+
+    constexpr bool operator==(NTPTimestamp other) const { return _raw == other._raw; }
+    constexpr bool operator!=(NTPTimestamp other) const { return _raw != other._raw; }
+    constexpr bool operator<(NTPTimestamp other) const { return (*this - other).raw() < 0; }
+    constexpr bool operator<=(NTPTimestamp other) const { return (*this - other).raw() <= 0; }
+    constexpr bool operator>(NTPTimestamp other) const { return (*this - other).raw() > 0; }
+    constexpr bool operator>=(NTPTimestamp other) const { return (*this - other).raw() >= 0; }
+
+    static constexpr uint64_t ERA_OFFSET0_1_JAN_1970 = 2208988800ULL; ///< Seconds from 1900 to 1970
+
+private:
+    constexpr explicit NTPTimestamp(uint64_t raw) : _raw(raw) {}
+    uint64_t _raw;
+};
+
+/**
+ * @brief NTP Short Format: unsigned 16.16 fixed point seconds, used for root delay and dispersion.
+ */
+class NTPShort
+{
+public:
+    constexpr NTPShort() : _raw(0) {}
+    constexpr NTPShort(uint16_t seconds, uint16_t fraction) : _raw((uint32_t)seconds << 16 | fraction) {}
+    static constexpr NTPShort fromRaw(uint32_t raw) { return NTPShort(raw); }
+    /// Converts a short timestamp as it is found in a ntp_packet.
+    static constexpr NTPShort decode(uint32_t wire) { return NTPShort(ntp_detail::wire32(wire)); }
+    /// Converts a duration, negative ones become zero and too large ones saturate.
+    static constexpr NTPShort fromDuration(NTPDuration d)
+    {
+        return d.raw() <= 0 ? NTPShort(0U) : (d.raw() >> 16) > 0xffffffffLL ? NTPShort(0xffffffffU) : NTPShort((uint32_t)(d.raw() >> 16));
+    }
+
+    constexpr uint32_t raw() const { return _raw; }
+    constexpr uint16_t seconds() const { return (uint16_t)(_raw >> 16); }
+    constexpr uint16_t fraction() const { return (uint16_t)_raw; }
+    /// Converts the short timestamp into the layout of a ntp_packet.
+    constexpr uint32_t encode() const { return ntp_detail::wire32(_raw); }
+    constexpr NTPDuration toDuration() const { return NTPDuration::fromRaw((int64_t)_raw << 16); }
+    constexpr double toSeconds() const { return _raw / 65536.; }
+
+    constexpr NTPShort operator+(NTPShort other) const { return NTPShort(_raw + other._raw); }
+    constexpr bool operator==(NTPShort other) const { return _raw == other._raw; }
+    constexpr bool operator!=(NTPShort other) const { return _raw != other._raw; }
+    constexpr bool operator<(NTPShort other) const { return _raw < other._raw; }
+
+private:
+    constexpr explicit NTPShort(uint32_t raw) : _raw(raw) {}
+    uint32_t _raw;
+};
@@ -0,0 +1,306 @@
+/**
+ * @file PcapReader.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include "PcapReader.h"
+#include <Arduino.h>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @brief Creates a reader.
+ * 
+ * @param in Source of the pcapng data.  It must outlive the reader.
+ */
+NTPPcapReader::NTPPcapReader(Stream &in) : _in(in)
+{
+}
+
+/**
+ * @brief Reads the Section Header Block the file has to start with.
+ * 
+ * @return true if it is a pcapng section, false if not.  errno is EBADMSG then.
+ */
+bool NTPPcapReader::begin()
+{
+    uint8_t type[4];
+    if ((_in.readBytes(type, sizeof(type)) != sizeof(type)) || (get32(type) != BLOCK_SHB))
+    {
+        // Not a pcapng file.
+        errno = EBADMSG;
+        return false;
+    }
+    _has_request = false;
+    return read_section();
+}
+
+/**
+ * @brief Reads the next exchange.
+ * 
+ * @param[out] record Receives the exchange.
+ * @return true if an exchange has been read.  false at the end of the capture (errno is ENODATA
+ * then) or if the capture is broken (errno is EBADMSG).
+ */
+bool NTPPcapReader::next(NTPReplayTransport::ntp_record *record)
+{
+    if (record == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    uint8_t header[8];
+    uint8_t body[MAX_BODY + 4U];
+    while (_in.readBytes(header, 4U) == 4U)
+    {
+        uint32_t type = get32(header);
+        if (type == BLOCK_SHB)
+        {
+            // A new section, maybe in the other byte order.
+            if (read_section() == false)
+                return false;
+            continue;
+        }
+        if (_in.readBytes(header + 4, 4U) != 4U)
+            break;
+        uint32_t length = get32(header + 4);
+        // Block Total Length counts type, length, body and the trailing length.
+        if ((length < 12U) || (length % 4U != 0))
+        {
+            // Broken block.
+            errno = EBADMSG;
+            return false;
+        }
+        size_t body_length = length - 12U;
+        if ((body_length > MAX_BODY) || ((type != BLOCK_IDB) && (type != BLOCK_EPB)))
+        {
+            if (skip(body_length + 4U) == false)
+                return false;
+            continue;
+        }
+        if (_in.readBytes(body, body_length + 4U) != body_length + 4U)
+            break;
+        if ((type == BLOCK_IDB) && (read_interface(body, body_length) == false))
+            return false;
+        if (type == BLOCK_EPB)
+        {
+            bool complete = false;
+            if (read_packet(body, body_length, record, &complete) == false)
+                return false;
+            if (complete)
+                return true;
+        }
+    }
+    // End of the capture.
+    errno = ENODATA;
+    return false;
+}
+
+/**
+ * @brief Reads up to count exchanges.
+ * 
+ * @return Number of records read.  errno tells why there are not more.
+ */
+size_t NTPPcapReader::read(NTPReplayTransport::ntp_record *records, size_t count)
+{
+    size_t n = 0;
+    while ((n < count) && next(&records[n]))
+        n++;
+    return n;
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+/**
+ * @brief Reads the rest of a Section Header Block after its type.
+ * 
+ * The byte order magic tells in which order all blocks of the section are written.
+ */
+bool NTPPcapReader::read_section()
+{
+    uint8_t length_and_magic[8];
+    if (_in.readBytes(length_and_magic, sizeof(length_and_magic)) != sizeof(length_and_magic))
+    {
+        // Truncated section header.
+        errno = EBADMSG;
+        return false;
+    }
+    uint32_t magic;
+    memcpy(&magic, length_and_magic + 4, sizeof(magic));
+    if (magic == BYTE_ORDER_MAGIC)
+        _swapped = false;
+    else if (magic == __builtin_bswap32(BYTE_ORDER_MAGIC))
+        _swapped = true;
+    else
+    {
+        // Unknown byte order.
+        errno = EBADMSG;
+        return false;
+    }
+    uint32_t length = get32(length_and_magic);
+    if ((length < 28U) || (length % 4U != 0))
+    {
+        // Broken block.
+        errno = EBADMSG;
+        return false;
+    }
+    // Every section brings its own interfaces.
+    _tsresol = TSRESOL_MICROSECONDS;
+    // Skip versions, section length, options and the trailing length.
+    return skip(length - 12U);
+}
+
+/**
+ * @brief Takes the timestamp resolution of the interface.  Only one interface is supported.
+ * 
+ * @return true if ok, false if the resolution is not supported.  errno is EBADMSG then.
+ */
+bool NTPPcapReader::read_interface(const uint8_t *body, size_t length)
+{
+    // Link type, reserved and snap length come first, options follow.
+    size_t pos = 8U;
+    while (pos + 4U <= length)
+    {
+        uint16_t code = get16(body + pos);
+        uint16_t option_length = get16(body + pos + 2);
+        pos += 4U;
+        if ((code == OPT_ENDOFOPT) || (pos + option_length > length))
+            break;
+        if ((code == OPT_IF_TSRESOL) && (option_length == 1U))
+        {
+            uint8_t exponent = body[pos] & ~TSRESOL_BINARY;
+            if (exponent > ((body[pos] & TSRESOL_BINARY) ? MAX_TSRESOL_BINARY : MAX_TSRESOL_DECIMAL))
+            {
+                // Resolution we cannot convert.
+                errno = EBADMSG;
+                return false;
+            }
+            _tsresol = body[pos];
+        }
+        // Option values are padded to 32 bit.
+        pos += (option_length + 3U) & ~3U;
+    }
+    return true;
+}
+
+/**
+ * @brief Takes a NTP packet out of an Enhanced Packet Block.
+ * 
+ * @param[out] complete Set if it has been the reply completing an exchange, which is in record then.
+ * @return true if ok, false if the IPv4 header is broken.  errno is EBADMSG then.
+ */
+bool NTPPcapReader::read_packet(const uint8_t *body, size_t length, NTPReplayTransport::ntp_record *record,
+                                bool *complete)
+{
+    constexpr size_t IP_HEADER_MIN = 20U;
+    constexpr size_t UDP_HEADER_SIZE = 8U;
+    *complete = false;
+    if (length < 20U)
+        return true;
+    uint64_t ticks = (uint64_t)get32(body + 4) << 32 | get32(body + 8);
+    size_t captured = get32(body + 12);
+    const uint8_t *ip = body + 20;
+    if ((captured > length - 20U) || (captured < IP_HEADER_MIN) || ((ip[0] >> 4) != 4) || (ip[9] != 17))
+        return true; // No IPv4/UDP packet.
+    size_t ip_header = (ip[0] & 0x0f) * 4U;
+    if (ip_header < IP_HEADER_MIN)
+    {
+        // Internet Header Length below its minimum of 5 words.
+        errno = EBADMSG;
+        return false;
+    }
+    if (captured < ip_header + UDP_HEADER_SIZE + NTPMessageTransport::NTP_PACKET_SIZE)
+        return true; // Too short for NTP.
+    // Header fields of the packet are in network byte order, whatever the section says.
+    const uint8_t *udp = ip + ip_header;
+    uint16_t src_port = (uint16_t)(udp[0] << 8 | udp[1]);
+    uint16_t dst_port = (uint16_t)(udp[2] << 8 | udp[3]);
+    const uint8_t *payload = udp + UDP_HEADER_SIZE;
+
+    if (dst_port == NTP_SERVER_PORT)
+    {
+        memcpy(&_request, payload, sizeof(_request));
+        _request_ticks = ticks;
+        _has_request = true;
+        return true;
+    }
+    if ((src_port != NTP_SERVER_PORT) || !_has_request)
+        return true;
+    // The reply is kept as it has been received, even if it does not match the request.  So
+    // stale or forged replies can be replayed as well.
+    _has_request = false;
+    *record = NTPReplayTransport::ntp_record();
+    record->t1 = _request.xmt;
+    memcpy(&record->reply, payload, sizeof(record->reply));
+    record->roundtrip_us = to_micros(ticks - _request_ticks);
+    *complete = true;
+    return true;
+}
+
+/**
+ * @brief Reads and drops length bytes.
+ */
+bool NTPPcapReader::skip(size_t length)
+{
+    uint8_t scratch[32];
+    while (length > 0)
+    {
+        size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+        if (_in.readBytes(scratch, chunk) != chunk)
+        {
+            // Truncated block.
+            errno = EBADMSG;
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
+uint32_t NTPPcapReader::get32(const uint8_t *bytes) const
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return _swapped ? __builtin_bswap32(value) : value;
+}
+
+uint16_t NTPPcapReader::get16(const uint8_t *bytes) const
+{
+    uint16_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return _swapped ? __builtin_bswap16(value) : value;
+}
+
+/**
+ * @brief Converts a difference of capture times into microseconds.
+ * 
+ * The interface gives the resolution as 10^-n s or, with the highest bit set, as 2^-n s.
+ * read_interface() has made sure n is in range.
+ */
+unsigned long NTPPcapReader::to_micros(uint64_t ticks) const
+{
+    uint8_t exponent = _tsresol & ~TSRESOL_BINARY;
+    if (_tsresol & TSRESOL_BINARY)
+    {
+        double us = ldexp((double)ticks * 1e6, -exponent);
+        return us < (double)ULONG_MAX ? (unsigned long)us : ULONG_MAX;
+    }
+    uint64_t scale = 1U;
+    for (uint8_t i = 6; i < exponent; i++)
+        scale *= 10U;
+    for (uint8_t i = exponent; i < 6; i++)
+        ticks *= 10U;
+    return (unsigned long)(ticks / scale);
+}
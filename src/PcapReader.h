@@ -0,0 +1,70 @@
+/**
+ * @file PcapReader.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "ReplayTransport.h"
+#include <Stream.h>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Reads exchanges captured as pcapng back into records for NTPReplayTransport.
+ * 
+ * Section Header, Interface Description and Enhanced Packet Blocks are parsed, every other
+ * block is skipped.  A packet to port 123 is taken as request, the next packet from port 123 as
+ * its reply.  T1 is the Transmit Timestamp of the request, the round-trip is the difference of
+ * the capture times of both packets.  Files of NTPPcapWriter read back exactly; other captures
+ * work as long as they hold raw IPv4 packets (LINKTYPE_RAW) of one interface.
+ * 
+ * The input can be anything readable, e.g. a LittleFS File.
+ * 
+ * \sa NTPPcapWriter
+ */
+class NTPPcapReader
+{
+public:
+    explicit NTPPcapReader(Stream &in);
+    bool begin();
+    bool next(NTPReplayTransport::ntp_record *record);
+    size_t read(NTPReplayTransport::ntp_record *records, size_t count);
+
+protected:
+    static constexpr uint32_t BLOCK_SHB = 0x0A0D0D0AUL; ///< Section Header Block
+    static constexpr uint32_t BLOCK_IDB = 0x00000001UL; ///< Interface Description Block
+    static constexpr uint32_t BLOCK_EPB = 0x00000006UL; ///< Enhanced Packet Block
+    static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4DUL;
+    static constexpr uint16_t OPT_ENDOFOPT = 0U;
+    static constexpr uint16_t OPT_IF_TSRESOL = 9U;
+    static constexpr uint8_t TSRESOL_MICROSECONDS = 6U; ///< Default if the interface does not tell
+    static constexpr uint8_t TSRESOL_BINARY = 0x80U;    ///< Resolution given as 2^-n s
+    static constexpr uint8_t MAX_TSRESOL_DECIMAL = 19U; ///< 10^19 still fits into 64 bit
+    static constexpr uint8_t MAX_TSRESOL_BINARY = 63U;
+    static constexpr uint16_t NTP_SERVER_PORT = 123U;
+    static constexpr size_t MAX_BODY = 256U;            ///< Larger blocks are no NTP packets of ours
+
+    bool read_section();
+    bool read_interface(const uint8_t *body, size_t length);
+    bool read_packet(const uint8_t *body, size_t length, NTPReplayTransport::ntp_record *record, bool *complete);
+    bool skip(size_t length);
+    uint32_t get32(const uint8_t *bytes) const;
+    uint16_t get16(const uint8_t *bytes) const;
+    unsigned long to_micros(uint64_t ticks) const;
+
+private:
+    Stream &_in;
+    bool _swapped = false;                  ///< Section written in the other byte order
+    uint8_t _tsresol = TSRESOL_MICROSECONDS;
+    bool _has_request = false;
+    NTPMessageTransport::ntp_packet _request;
+    uint64_t _request_ticks = 0;
+};
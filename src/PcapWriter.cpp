@@ -0,0 +1,152 @@
+/**
+ * @file PcapWriter.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include "PcapWriter.h"
+#include <Arduino.h>
+#include <cstring>
+
+/**
+ * @brief Creates a writer.
+ * 
+ * @param out Destination of the pcapng data.  It must outlive the writer.
+ */
+NTPPcapWriter::NTPPcapWriter(Print &out) : _out(out)
+{
+}
+
+/**
+ * @brief Writes the section header and the description of the one and only interface.
+ * 
+ * @return true if the headers have been written, false if the output did not take them.
+ * 
+ * Call this once before attaching the writer with NTPMessageTransport::setCaptureSink().
+ * All blocks are written in host byte order as pcapng allows it.
+ */
+bool NTPPcapWriter::begin()
+{
+    // Section Header Block without options: 28 bytes.
+    constexpr uint32_t SHB_LENGTH = 28U;
+    write32(BLOCK_SHB);
+    write32(SHB_LENGTH);
+    write32(BYTE_ORDER_MAGIC);
+    write16(1U); // Major version
+    write16(0U); // Minor version
+    write32(0xFFFFFFFFUL); // Section length unknown (64 bit -1)
+    write32(0xFFFFFFFFUL);
+    write32(SHB_LENGTH);
+
+    // Interface Description Block with if_tsresol and opt_endofopt: 32 bytes.
+    constexpr uint32_t IDB_LENGTH = 32U;
+    write32(BLOCK_IDB);
+    write32(IDB_LENGTH);
+    write16(LINKTYPE_RAW);
+    write16(0U); // Reserved
+    write32(0U); // No snap length limit
+    write16(OPT_IF_TSRESOL);
+    write16(1U);
+    const uint8_t tsresol[4] = {TSRESOL_NANOSECONDS, 0, 0, 0}; // Value padded to 32 bit
+    _out.write(tsresol, sizeof(tsresol));
+    write32(0U); // opt_endofopt
+    return write32(IDB_LENGTH) == sizeof(uint32_t);
+}
+
+/**
+ * @brief Writes the request at T1 and the reply at T4.
+ */
+void NTPPcapWriter::capture(const NTPMessageTransport::ntp_packet &request, const NTPMessageTransport::ntp_packet &reply,
+                            const IPAddress &server, uint16_t local_port, NTPMessageTransport::tstamp64_t t4)
+{
+    uint32_t local_ip = (uint32_t)WiFi.localIP();
+    uint32_t server_ip = (uint32_t)server;
+
+    write_packet(unix_nanoseconds(request.xmt), local_ip, local_port, server_ip, NTP_SERVER_PORT, request);
+    write_packet(unix_nanoseconds(t4), server_ip, NTP_SERVER_PORT, local_ip, local_port, reply);
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+/**
+ * @brief Writes an Enhanced Packet Block holding a synthesized IPv4/UDP datagram.
+ * 
+ * Addresses are given in network byte order like IPAddress holds them, ports in host byte order.
+ * The UDP checksum is left zero, which means "not computed" for IPv4.
+ */
+void NTPPcapWriter::write_packet(uint64_t unix_ns, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                                 const NTPMessageTransport::ntp_packet &payload)
+{
+    static_assert(FRAME_SIZE % 4 == 0, "Packet data would need padding");
+    uint8_t frame[FRAME_SIZE] = {};
+    uint8_t *ip = frame;
+    uint8_t *udp = frame + IP_HEADER_SIZE;
+
+    ip[0] = 0x45; // IPv4, header length 5 * 32 bit
+    ip[2] = FRAME_SIZE >> 8;
+    ip[3] = FRAME_SIZE & 0xff;
+    ip[4] = _ip_id >> 8;
+    ip[5] = _ip_id & 0xff;
+    _ip_id++;
+    ip[8] = 64; // TTL
+    ip[9] = 17; // UDP
+    memcpy(ip + 12, &src_ip, 4);
+    memcpy(ip + 16, &dst_ip, 4);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < IP_HEADER_SIZE; i += 2)
+    {
+        sum += (uint32_t)ip[i] << 8 | ip[i + 1];
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    ip[10] = ~sum >> 8;
+    ip[11] = ~sum & 0xff;
+
+    constexpr uint16_t UDP_LENGTH = UDP_HEADER_SIZE + NTPMessageTransport::NTP_PACKET_SIZE;
+    udp[0] = src_port >> 8;
+    udp[1] = src_port & 0xff;
+    udp[2] = dst_port >> 8;
+    udp[3] = dst_port & 0xff;
+    udp[4] = UDP_LENGTH >> 8;
+    udp[5] = UDP_LENGTH & 0xff;
+    memcpy(udp + UDP_HEADER_SIZE, &payload, NTPMessageTransport::NTP_PACKET_SIZE);
+
+    constexpr uint32_t EPB_LENGTH = 32U + FRAME_SIZE;
+    write32(BLOCK_EPB);
+    write32(EPB_LENGTH);
+    write32(0U); // Interface id
+    write32((uint32_t)(unix_ns >> 32));
+    write32((uint32_t)(unix_ns & 0xffffffff));
+    write32(FRAME_SIZE); // Captured length
+    write32(FRAME_SIZE); // Original length
+    _out.write(frame, FRAME_SIZE);
+    write32(EPB_LENGTH);
+}
+
+size_t NTPPcapWriter::write32(uint32_t value)
+{
+    return _out.write((const uint8_t *)&value, sizeof(value));
+}
+
+size_t NTPPcapWriter::write16(uint16_t value)
+{
+    return _out.write((const uint8_t *)&value, sizeof(value));
+}
+
+/**
+ * @brief Converts a NTP timestamp into nanoseconds since 1. Jan. 1970Z00:00:00.
+ */
+uint64_t NTPPcapWriter::unix_nanoseconds(const NTPMessageTransport::tstamp64_t &ts)
+{
+    return NTPTimestamp::decode(ts).toUnix().count();
+}
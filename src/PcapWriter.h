@@ -0,0 +1,61 @@
+/**
+ * @file PcapWriter.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "MessageTransport.h"
+#include <Print.h>
+#include <cstdbool>
+#include <cstdint>
+
+/**
+ * @brief Writes captured exchanges as pcapng with nanosecond timestamps.
+ * 
+ * Every exchange becomes two IPv4/UDP packets: the request stamped with the local T1 and the
+ * reply stamped with the local T4.  The files can be opened with Wireshark or tcpdump and carry
+ * everything needed to redo the On-Wire computation offline.
+ * 
+ * The output can be anything printable, e.g. a LittleFS File or a Serial port.
+ * 
+ * \sa https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-01.html
+ * \sa NTPCaptureSink
+ */
+class NTPPcapWriter : public NTPCaptureSink
+{
+public:
+    explicit NTPPcapWriter(Print &out);
+    bool begin();
+    void capture(const NTPMessageTransport::ntp_packet &request, const NTPMessageTransport::ntp_packet &reply,
+                 const IPAddress &server, uint16_t local_port, NTPMessageTransport::tstamp64_t t4) override;
+
+protected:
+    static constexpr uint32_t BLOCK_SHB = 0x0A0D0D0AUL;   ///< Section Header Block
+    static constexpr uint32_t BLOCK_IDB = 0x00000001UL;   ///< Interface Description Block
+    static constexpr uint32_t BLOCK_EPB = 0x00000006UL;   ///< Enhanced Packet Block
+    static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4DUL;
+    static constexpr uint16_t LINKTYPE_RAW = 101U;        ///< Packets start with the IP header
+    static constexpr uint16_t OPT_IF_TSRESOL = 9U;
+    static constexpr uint8_t TSRESOL_NANOSECONDS = 9U;    ///< 10^-9 s
+    static constexpr uint16_t NTP_SERVER_PORT = 123U;
+    static constexpr size_t IP_HEADER_SIZE = 20U;
+    static constexpr size_t UDP_HEADER_SIZE = 8U;
+    static constexpr size_t FRAME_SIZE = IP_HEADER_SIZE + UDP_HEADER_SIZE + NTPMessageTransport::NTP_PACKET_SIZE;
+
+    void write_packet(uint64_t unix_ns, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                      const NTPMessageTransport::ntp_packet &payload);
+    size_t write32(uint32_t value);
+    size_t write16(uint16_t value);
+    static uint64_t unix_nanoseconds(const NTPMessageTransport::tstamp64_t &ts);
+
+private:
+    Print &_out;
+    uint16_t _ip_id = 0;
+};
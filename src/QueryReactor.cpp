@@ -0,0 +1,187 @@
+/**
+ * @file QueryReactor.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "QueryReactor.h"
+
+#if defined(SNTPV4_HAS_COROUTINES)
+#include <cerrno>
+
+void NTPCancelToken::cancel()
+{
+    _cancelled = true;
+}
+
+bool NTPCancelToken::cancelled() const
+{
+    return _cancelled;
+}
+
+void NTPCancelToken::reset()
+{
+    _cancelled = false;
+}
+
+NTPQueryAwaiter::NTPQueryAwaiter(NTPReactor &reactor, NTPClient &client, unsigned long timeout, NTPCancelToken *token)
+    : _reactor(reactor), _client(client), _timeout(timeout), _token(token), _result()
+{
+}
+
+/**
+ * @brief Leaves the reactor if the coroutine is destroyed while the query is pending.
+ */
+NTPQueryAwaiter::~NTPQueryAwaiter()
+{
+    if (_attached)
+    {
+        _reactor.detach(this);
+        _client.cancelQuery();
+    }
+}
+
+bool NTPQueryAwaiter::await_ready() const noexcept
+{
+    return false;
+}
+
+/**
+ * @brief Sends the request and parks the coroutine at the reactor.
+ * 
+ * @return false if the query could not be started, so the coroutine goes on at once.
+ */
+bool NTPQueryAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    _handle = handle;
+    if (cancelled())
+    {
+        return false;
+    }
+    if (_client.startQuery(_timeout) == false)
+    {
+        _result.error = errno;
+        return false;
+    }
+    _reactor.attach(this);
+    return true;
+}
+
+ntp_query_result NTPQueryAwaiter::await_resume() const noexcept
+{
+    return _result;
+}
+
+/**
+ * @brief Checks the query once.
+ * 
+ * @return true if the query has finished and the coroutine may be resumed.
+ */
+bool NTPQueryAwaiter::poll()
+{
+    if (cancelled())
+    {
+        _client.cancelQuery();
+        return true;
+    }
+    if (_client.pollQuery(&_result.sample) == true)
+    {
+        _result.ok = true;
+        _result.error = 0;
+        return true;
+    }
+    if ((errno == EINPROGRESS) || (errno == EALREADY))
+    {
+        // Still pending, EALREADY if another task holds the client.
+        return false;
+    }
+    _result.error = errno;
+    return true;
+}
+
+bool NTPQueryAwaiter::cancelled()
+{
+    if ((_token == nullptr) || !_token->cancelled())
+    {
+        return false;
+    }
+    _result.ok = false;
+    _result.error = ECANCELED;
+    return true;
+}
+
+/**
+ * @brief Creates the awaitable for a query of the given client.
+ * 
+ * @param client The client to query.  It must not be used otherwise until the query has finished.
+ * @param timeout Milliseconds to wait for the reply.
+ * @param token Optional token to cancel the query.
+ */
+NTPQueryAwaiter NTPReactor::query(NTPClient &client, unsigned long timeout, NTPCancelToken *token)
+{
+    return NTPQueryAwaiter(*this, client, timeout, token);
+}
+
+/**
+ * @brief Polls all pending queries and resumes the coroutines of the finished ones.
+ * 
+ * @return size_t Number of queries still pending.
+ */
+size_t NTPReactor::poll()
+{
+    size_t pending = 0;
+    NTPQueryAwaiter **link = &_pending;
+    while (*link != nullptr)
+    {
+        NTPQueryAwaiter *awaiter = *link;
+        if (awaiter->poll() == false)
+        {
+            pending++;
+            link = &awaiter->_next;
+            continue;
+        }
+        // Unlink before resuming.  The coroutine may destroy the awaiter or start new queries,
+        // which are attached at the head and therefore do not disturb this walk.
+        *link = awaiter->_next;
+        awaiter->_next = nullptr;
+        awaiter->_attached = false;
+        awaiter->_handle.resume();
+    }
+    return pending;
+}
+
+/**
+ * @brief Tells whether no query is pending.
+ */
+bool NTPReactor::idle() const
+{
+    return _pending == nullptr;
+}
+
+void NTPReactor::attach(NTPQueryAwaiter *awaiter)
+{
+    awaiter->_next = _pending;
+    _pending = awaiter;
+    awaiter->_attached = true;
+}
+
+void NTPReactor::detach(NTPQueryAwaiter *awaiter)
+{
+    for (NTPQueryAwaiter **link = &_pending; *link != nullptr; link = &(*link)->_next)
+    {
+        if (*link == awaiter)
+        {
+            *link = awaiter->_next;
+            break;
+        }
+    }
+    awaiter->_next = nullptr;
+    awaiter->_attached = false;
+}
+
+#endif
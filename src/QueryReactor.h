@@ -0,0 +1,109 @@
+/**
+ * @file QueryReactor.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "ntpclient.h"
+
+// C++20 coroutines are needed.  Everything in here silently disappears on older toolchains.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define SNTPV4_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <cstdbool>
+#include <cstddef>
+
+/**
+ * @brief Outcome of a query awaited with NTPReactor::query().
+ */
+struct ntp_query_result
+{
+    bool ok;                   ///< true if the sample is valid
+    int error;                 ///< errno value if not ok, ECANCELED if cancelled, ETIMEDOUT on timeout
+    NTPClient::ntp_sample sample;
+};
+
+/**
+ * @brief Lets somebody else cancel an awaited query.  The query ends with ECANCELED.
+ */
+class NTPCancelToken
+{
+public:
+    void cancel();
+    bool cancelled() const;
+    void reset();
+
+private:
+    bool _cancelled = false;
+};
+
+class NTPReactor;
+
+/**
+ * @brief Awaitable of a single query, q.v. NTPReactor::query().
+ */
+class NTPQueryAwaiter
+{
+public:
+    NTPQueryAwaiter(NTPReactor &reactor, NTPClient &client, unsigned long timeout, NTPCancelToken *token);
+    ~NTPQueryAwaiter();
+    NTPQueryAwaiter(const NTPQueryAwaiter &) = delete;
+    NTPQueryAwaiter &operator=(const NTPQueryAwaiter &) = delete;
+    bool await_ready() const noexcept;
+    bool await_suspend(std::coroutine_handle<> handle);
+    ntp_query_result await_resume() const noexcept;
+
+protected:
+    friend class NTPReactor;
+    bool poll();
+    bool cancelled();
+
+private:
+    NTPReactor &_reactor;
+    NTPClient &_client;
+    unsigned long _timeout;
+    NTPCancelToken *_token;
+    std::coroutine_handle<> _handle;
+    ntp_query_result _result;
+    NTPQueryAwaiter *_next = nullptr; ///< Intrusive list of pending queries, no allocations needed.
+    bool _attached = false;           ///< Linked into the list of the reactor.
+};
+
+/**
+ * @brief Drives awaited queries from a single thread.
+ * 
+ * Coroutines suspend in
+ * 
+ *     ntp_query_result result = co_await reactor.query(client);
+ * 
+ * and are resumed from within poll() once their reply is there, the timeout has passed or the query
+ * has been cancelled.  Call poll() from loop() or from the event loop of your application.  There is
+ * no thread and no callback per query, and the pending queries live in the coroutine frames.
+ * 
+ * Each concurrent query needs its own NTPClient.
+ */
+class NTPReactor
+{
+public:
+    NTPQueryAwaiter query(NTPClient &client, unsigned long timeout = NTPClient::TIMEOUT, NTPCancelToken *token = nullptr);
+    size_t poll();
+    bool idle() const;
+
+protected:
+    friend class NTPQueryAwaiter;
+    void attach(NTPQueryAwaiter *awaiter);
+    void detach(NTPQueryAwaiter *awaiter);
+
+private:
+    NTPQueryAwaiter *_pending = nullptr;
+};
+
+#endif
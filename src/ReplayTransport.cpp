@@ -0,0 +1,218 @@
+/**
+ * @file ReplayTransport.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include "ReplayTransport.h"
+#include "NTPClock.h"
+#include <Arduino.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @brief Makes up exchanges with a server, e.g. to check the client against a known offset.
+ * 
+ * The first request leaves at NTPTimeBase::INTERIM_EPOCH, the others follow every 16 seconds.
+ * The queueing delays are pseudo random, but the same with every call.
+ * 
+ * @param scenario The server and the path to it.
+ * @param[out] records Receives the exchanges.
+ * @param count Number of records.
+ */
+void NTPStaticReplayTransport::synthesize(const ntp_scenario &scenario, ntp_record *records, size_t count)
+{
+    // Linear congruential generator giving numbers in [0, 1).
+    uint32_t state = 42;
+    auto next_random = [&state]() {
+        state = state * 1664525UL + 1013904223UL;
+        return (state >> 8) / 16777216.0;
+    };
+    for (size_t i = 0; i < count; i++)
+    {
+        double out = scenario.out_s + scenario.queue_s * next_random();
+        double back = scenario.back_s + scenario.queue_s * next_random();
+        NTPTimestamp t1 = NTPTimeBase::INTERIM_EPOCH + NTPDuration::fromSeconds(16.0 * i);
+        NTPTimestamp t2 = t1 + NTPDuration::fromSeconds(out + scenario.offset_s);
+        NTPTimestamp t3 = t2 + NTPDuration::fromMicros(500); // Server processing time
+
+        ntp_record &r = records[i];
+        r = ntp_record();
+        r.t1 = t1.encode();
+        r.reply.li_vn_mode = (uint8_t)(scenario.leap << 6) | 0b00'100'100; // Version 4, server mode
+        r.reply.stratum = scenario.stratum;
+        r.reply.precision = -20;
+        memcpy(&r.reply.refid, scenario.stratum == 0 ? "RATE" : "GPS\0", 4);
+        r.reply.reftime = (t2 - NTPDuration::fromSeconds(8.0)).encode();
+        r.reply.org = scenario.stale ? (t1 - NTPDuration::fromMicros(500000)).encode() : r.t1;
+        r.reply.rec = t2.encode();
+        r.reply.xmt = t3.encode();
+        // T4 - T1 is the delay of both ways plus the processing time.  The offset cancels out.
+        r.roundtrip_us = (unsigned long)lround((out + back) * 1e6) + 500UL;
+    }
+}
+
+/**
+ * @brief Creates a replay of the given records one per exchange.
+ * 
+ * @param records The recorded exchanges.  They must outlive the transport.
+ * @param count Number of records.
+ */
+NTPStaticReplayTransport::NTPStaticReplayTransport(const ntp_record *records, size_t count)
+    : _records(records), _count(count)
+{
+}
+
+/**
+ * @brief Starts the replay from the first record again.
+ */
+void NTPStaticReplayTransport::rewind()
+{
+    _position = 0;
+    _exchange_pending = false;
+}
+
+/**
+ * @brief Index of the record the next exchange will be answered with.
+ */
+size_t NTPStaticReplayTransport::position() const
+{
+    return _position;
+}
+
+/**
+ * @brief Takes the request and gives the reply of the next record, q.v. NTPMessageTransport::packetExchange().
+ */
+bool NTPStaticReplayTransport::packetExchange(ntp_packet *packet, unsigned long timeout)
+{
+    if (timeout == 0)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    return beginExchange(packet) && pollExchange(packet);
+}
+
+/**
+ * @brief Takes the request, q.v. NTPMessageTransport::beginExchange().
+ */
+bool NTPStaticReplayTransport::beginExchange(ntp_packet *packet)
+{
+    if (packet == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    _request_xmt = packet->xmt;
+    _exchange_pending = true;
+    return true;
+}
+
+/**
+ * @brief Gives the reply of the next record fitted to the request, q.v. NTPMessageTransport::pollExchange().
+ * 
+ * @return true if there is a reply, false if not.  errno is ETIMEDOUT if the records are used up.
+ */
+bool NTPStaticReplayTransport::pollExchange(ntp_packet *packet)
+{
+    if ((packet == nullptr) || !_exchange_pending)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    _exchange_pending = false;
+    if (_position >= _count)
+    {
+        // The recording is exhausted.  Looks like the server does not answer.
+        errno = ETIMEDOUT;
+        return false;
+    }
+    const ntp_record &record = _records[_position++];
+
+    // Move the server timestamps onto the time scale of the current request.
+    NTPDuration shift = NTPTimestamp::decode(_request_xmt) - NTPTimestamp::decode(record.t1);
+    *packet = record.reply;
+    // A reply answering its recorded request gets the Originate Timestamp of the current one.
+    // Any other one, e.g. a stale or forged reply, keeps its own so the client rejects it again.
+    if (record.reply.org == record.t1)
+        packet->org = _request_xmt;
+    packet->rec = (NTPTimestamp::decode(record.reply.rec) + shift).encode();
+    packet->xmt = (NTPTimestamp::decode(record.reply.xmt) + shift).encode();
+
+    // The reply arrives now, the request has left the recorded round-trip before.
+    _rx_micros = micros();
+    _tx_micros = _rx_micros - record.roundtrip_us;
+    return true;
+}
+
+/**
+ * @brief Abandons a pending exchange.  Its record stays for the next one.
+ */
+void NTPStaticReplayTransport::cancelExchange()
+{
+    _exchange_pending = false;
+}
+
+/**
+ * @brief Creates a transport replaying the given records one per exchange.
+ * 
+ * @param records The recorded exchanges.  They must outlive the transport.
+ * @param count Number of records.
+ */
+NTPReplayTransport::NTPReplayTransport(const ntp_record *records, size_t count)
+    : _replay(records, count)
+{
+}
+
+/**
+ * @brief Starts the replay from the first record again.
+ */
+void NTPReplayTransport::rewind()
+{
+    _replay.rewind();
+}
+
+/**
+ * @brief Index of the record the next exchange will be answered with.
+ */
+size_t NTPReplayTransport::position() const
+{
+    return _replay.position();
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+bool NTPReplayTransport::net_provider()
+{
+    // No network involved.
+    return true;
+}
+
+bool NTPReplayTransport::send_server_request(struct ntp_packet *ntp_request)
+{
+    return _replay.beginExchange(ntp_request);
+}
+
+bool NTPReplayTransport::poll_server_reply(struct ntp_packet *ntp_reply)
+{
+    if (_replay.pollExchange(ntp_reply) == false)
+    {
+        // Error code has been set.
+        return false;
+    }
+    _tx_micros = _replay.txMicros();
+    _rx_micros = _replay.rxMicros();
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file ReplayTransport.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "MessageTransport.h"
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Replay of recorded exchanges without virtual functions, e.g. as transport policy of
+ * NTPBasicClient.
+ * 
+ * A recorded reply only fits the request it has been recorded for.  So the replay moves the
+ * server timestamps by the difference between the new and the recorded T1 and sets the
+ * Originate Timestamp to the new T1.  Offset and delay stay exactly those of the record.  A
+ * reply whose Originate Timestamp did not match its recorded T1 keeps it, so it is rejected
+ * again (EBADMSG).  When the records are used up the exchange times out like an unanswered one.
+ * 
+ * Records come from a pcapng file read by NTPPcapReader or are made up by synthesize().
+ * 
+ * \sa NTPReplayTransport to replay through NTPClient.
+ */
+class NTPStaticReplayTransport final
+{
+public:
+    typedef NTPMessageTransport::ntp_packet ntp_packet;
+    typedef NTPMessageTransport::tstamp64_t tstamp64_t;
+
+    /// One recorded exchange.
+    struct ntp_record
+    {
+        tstamp64_t t1;             ///< local send time of the recorded request
+        ntp_packet reply;          ///< reply as it has been received
+        unsigned long roundtrip_us; ///< local time between sending and receiving (T4 - T1)
+    };
+
+    /// A server and the path to it, q.v. synthesize().
+    struct ntp_scenario
+    {
+        double offset_s; ///< true offset of the server against the client
+        double out_s;    ///< one-way delay client -> server
+        double back_s;   ///< one-way delay server -> client
+        double queue_s;  ///< maximal random queueing delay added to each direction
+        uint8_t leap;    ///< leap indicator of the server
+        uint8_t stratum; ///< stratum of the server, 0 for RATE Kiss-o'-Death replies
+        bool stale;      ///< the replies answer an older request
+    };
+
+    static void synthesize(const ntp_scenario &scenario, ntp_record *records, size_t count);
+
+    NTPStaticReplayTransport(const ntp_record *records, size_t count);
+    NTPStaticReplayTransport(const NTPStaticReplayTransport &) = delete;
+    NTPStaticReplayTransport &operator=(const NTPStaticReplayTransport &) = delete;
+
+    void rewind();
+    size_t position() const;
+    void setServerName(const char *) {} // There is nothing to resolve.
+    bool packetExchange(ntp_packet *packet, unsigned long timeout);
+    bool beginExchange(ntp_packet *packet);
+    bool pollExchange(ntp_packet *packet);
+    void cancelExchange();
+    unsigned long txMicros() const { return _tx_micros; }
+    unsigned long rxMicros() const { return _rx_micros; }
+
+private:
+    const ntp_record *_records;
+    size_t _count;
+    size_t _position = 0;
+    tstamp64_t _request_xmt = 0;
+    bool _exchange_pending = false;
+    unsigned long _tx_micros = 0;
+    unsigned long _rx_micros = 0;
+};
+
+/**
+ * @brief Transport that answers requests with recorded replies instead of using the network.
+ * 
+ * Feeding recorded exchanges through NTPClient makes offsets, delays and the handling of
+ * special replies (KoD, leap warnings, ...) reproducible, e.g. to check accuracy bounds or to
+ * measure the processing cost per sample.  NTPPcapReader takes the records from a pcapng file
+ * written by NTPPcapWriter: T1 is the timestamp of the request, T4 the one of the reply.
+ * 
+ * The replay itself is done by NTPStaticReplayTransport, q.v. there how the records are fitted
+ * to the requests.
+ * 
+ * \sa NTPClient::NTPClient(NTPMessageTransport &)
+ */
+class NTPReplayTransport : public NTPMessageTransport
+{
+public:
+    typedef NTPStaticReplayTransport::ntp_record ntp_record;
+    typedef NTPStaticReplayTransport::ntp_scenario ntp_scenario;
+
+    NTPReplayTransport(const ntp_record *records, size_t count);
+    void rewind();
+    size_t position() const;
+
+protected:
+    bool net_provider() override;
+    bool send_server_request(struct ntp_packet *ntp_request) override;
+    bool poll_server_reply(struct ntp_packet *ntp_reply) override;
+
+private:
+    NTPStaticReplayTransport _replay;
+};
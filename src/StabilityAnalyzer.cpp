@@ -0,0 +1,189 @@
+/**
+ * @file StabilityAnalyzer.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "StabilityAnalyzer.h"
+#include <cmath>
+#include <cstring>
+
+/**
+ * @brief Creates an analyzer for samples taken every tau0 seconds.
+ */
+NTPStabilityAnalyzer::NTPStabilityAnalyzer(double tau0) : _tau0(tau0)
+{
+    reset();
+}
+
+/**
+ * @brief Takes a sample.
+ * 
+ * @param time The synchronized time, e.g. client.timeBase().at(sample.local_us) after a query.
+ * @param local_us The local counter belonging to time.
+ */
+void NTPStabilityAnalyzer::add(NTPTimestamp time, int64_t local_us)
+{
+    if (!_has_origin)
+    {
+        _origin_time = time;
+        _origin_us = local_us;
+        _has_origin = true;
+    }
+    // Phase of the local clock against the synchronized time.  Differences keep the numbers
+    // small, so double keeps the nanoseconds.
+    NTPDuration phase = (time - _origin_time) - NTPDuration::fromMicros(local_us - _origin_us);
+    add(phase.toSeconds());
+}
+
+/**
+ * @brief Takes a phase sample in seconds, e.g. from a simulation.
+ */
+void NTPStabilityAnalyzer::add(double phase)
+{
+    _samples++;
+    feed(0, phase, phase);
+}
+
+/**
+ * @brief Forgets all samples.
+ */
+void NTPStabilityAnalyzer::reset()
+{
+    memset(_octaves, 0, sizeof(_octaves));
+    _samples = 0;
+    _has_origin = false;
+}
+
+/**
+ * @brief Number of samples taken.
+ */
+size_t NTPStabilityAnalyzer::samples() const
+{
+    return _samples;
+}
+
+/**
+ * @brief The deviations of all octaves with enough data, shortest tau first.
+ * 
+ * @param[out] points Receives the results.
+ * @param max_points Size of points.
+ * @return Number of points written.
+ */
+size_t NTPStabilityAnalyzer::points(stability_point *points, size_t max_points) const
+{
+    size_t count = 0;
+    for (size_t level = 0; (level < OCTAVES) && (count < max_points); level++)
+    {
+        const octave &oct = _octaves[level];
+        if (oct.terms < MIN_TERMS)
+            break;
+        double tau = _tau0 * (double)(1UL << level);
+        // sigma^2(tau) = <(x[i+2] - 2 x[i+1] + x[i])^2> / (2 tau^2), the modified one on block means.
+        points[count].tau = tau;
+        points[count].adev = sqrt(oct.adev_sum / (2.0 * tau * tau * oct.terms));
+        points[count].mdev = sqrt(oct.mdev_sum / (2.0 * tau * tau * oct.terms));
+        points[count].terms = oct.terms;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Poll interval in milliseconds at the minimum of the modified Allan deviation.
+ * 
+ * The modified deviation tells white phase noise (the network) from oscillator noise, which the
+ * plain one does not.  The result is a power of two seconds within MIN_POLL_MS and MAX_POLL_MS as
+ * NTP polls.  0 if there is not enough data yet.
+ */
+unsigned long NTPStabilityAnalyzer::suggestedPollInterval() const
+{
+    stability_point results[OCTAVES];
+    size_t count = points(results, OCTAVES);
+    if (count == 0)
+        return 0;
+    size_t best = 0;
+    for (size_t i = 1; i < count; i++)
+        if (results[i].mdev < results[best].mdev)
+            best = i;
+    // Round to the nearest power of two seconds.
+    double poll_ms = ldexp(1000.0, (int)lround(log2(results[best].tau)));
+    if (poll_ms < MIN_POLL_MS)
+        return MIN_POLL_MS;
+    if (poll_ms > MAX_POLL_MS)
+        return MAX_POLL_MS;
+    return (unsigned long)poll_ms;
+}
+
+/**
+ * @brief Prints the table of deviations and the suggested poll interval.
+ */
+void NTPStabilityAnalyzer::printTo(Print &out) const
+{
+    stability_point results[OCTAVES];
+    size_t count = points(results, OCTAVES);
+    out.print(F("samples "));
+    out.println((unsigned long)_samples);
+    for (size_t i = 0; i < count; i++)
+    {
+        out.print(F("tau "));
+        out.print(results[i].tau, 0);
+        out.print(F(" s: adev "));
+        out.print(results[i].adev * 1e9, 3);
+        out.print(F(" ppb, mdev "));
+        out.print(results[i].mdev * 1e9, 3);
+        out.print(F(" ppb, n "));
+        out.println((unsigned long)results[i].terms);
+    }
+    unsigned long poll_ms = suggestedPollInterval();
+    if (poll_ms != 0)
+    {
+        out.print(F("suggested poll "));
+        out.print(poll_ms / 1000UL);
+        out.println(F(" s"));
+    }
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+/**
+ * @brief Puts a decimated phase and block mean into an octave and passes pairs on to the next one.
+ */
+void NTPStabilityAnalyzer::feed(size_t level, double phase, double mean)
+{
+    octave &oct = _octaves[level];
+    oct.phase[0] = oct.phase[1];
+    oct.phase[1] = oct.phase[2];
+    oct.phase[2] = phase;
+    oct.mean[0] = oct.mean[1];
+    oct.mean[1] = oct.mean[2];
+    oct.mean[2] = mean;
+    if (oct.filled < 3)
+        oct.filled++;
+    if (oct.filled == 3)
+    {
+        double d = oct.phase[2] - 2.0 * oct.phase[1] + oct.phase[0];
+        double m = oct.mean[2] - 2.0 * oct.mean[1] + oct.mean[0];
+        oct.adev_sum += d * d;
+        oct.mdev_sum += m * m;
+        oct.terms++;
+    }
+    if (level + 1 >= OCTAVES)
+        return;
+    if (!oct.odd)
+    {
+        oct.pending_phase = phase;
+        oct.pending_mean = mean;
+        oct.odd = true;
+        return;
+    }
+    oct.odd = false;
+    feed(level + 1, oct.pending_phase, (oct.pending_mean + mean) / 2.0);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file StabilityAnalyzer.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "NTPTimestamp.h"
+#include <Print.h>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Streaming Allan and modified Allan deviation of the local oscillator.
+ * 
+ * Feed it one phase sample per poll, taken at a fixed interval tau0: the synchronized time of a
+ * sample and the local counter it belongs to.  Their difference is the phase of the free running
+ * local clock, so the frequency corrections of the time base do not disturb the result.
+ * 
+ * The samples run through a cascade of octaves.  Octave k sees every 2^k-th phase and the means
+ * of blocks of 2^k phases and keeps just the last three of each.  Their second differences give
+ * the Allan deviation and the modified Allan deviation at tau = 2^k * tau0.  So the memory is
+ * fixed to OCTAVES levels, however long the run is.
+ * 
+ * At short tau the deviation falls with the network noise averaging out, at long tau it rises
+ * with the wander of the oscillator.  suggestedPollInterval() is the tau of the minimum, the
+ * poll interval that lets the time base make the most of both.
+ */
+class NTPStabilityAnalyzer
+{
+public:
+    static constexpr size_t OCTAVES = 16;           ///< tau up to 2^15 * tau0
+    static constexpr uint32_t MIN_TERMS = 4;         ///< second differences before an octave is used
+    static constexpr unsigned long MIN_POLL_MS = 16000UL;    ///< 2^4 s, RFC 5905 MINPOLL
+    static constexpr unsigned long MAX_POLL_MS = 131072000UL; ///< 2^17 s, RFC 5905 MAXPOLL
+
+    struct stability_point
+    {
+        double tau;         ///< averaging time in seconds
+        double adev;        ///< Allan deviation
+        double mdev;        ///< modified Allan deviation
+        uint32_t terms;     ///< second differences averaged
+    };
+
+    explicit NTPStabilityAnalyzer(double tau0);
+    void add(NTPTimestamp time, int64_t local_us);
+    void add(double phase);
+    void reset();
+    size_t samples() const;
+    size_t points(stability_point *points, size_t max_points) const;
+    unsigned long suggestedPollInterval() const;
+    void printTo(Print &out) const;
+
+protected:
+    struct octave
+    {
+        double phase[3];   ///< last three phases, every 2^k-th sample
+        double mean[3];    ///< last three block means of 2^k samples
+        uint8_t filled;    ///< valid entries in phase and mean
+        bool odd;          ///< first of a pair is waiting in pending_*
+        double pending_phase;
+        double pending_mean;
+        double adev_sum;   ///< sum of squared second differences of phase
+        double mdev_sum;   ///< sum of squared second differences of block means
+        uint32_t terms;
+    };
+
+    void feed(size_t level, double phase, double mean);
+
+private:
+    double _tau0;
+    size_t _samples = 0;
+    bool _has_origin = false;
+    NTPTimestamp _origin_time;
+    int64_t _origin_us = 0;
+    octave _octaves[OCTAVES];
+};
@@ -0,0 +1,208 @@
+/**
+ * @file SyncMonitor.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "SyncMonitor.h"
+#include <Arduino.h>
+#include <cmath>
+
+/**
+ * @brief Takes the error bound from a time base fed with the same samples.
+ * 
+ * @param time_base The time base, nullptr for the own bound.  It must outlive the monitor.
+ * Bind it before the monitor is used from other tasks.
+ */
+void NTPSyncMonitor::bind(const NTPTimeBase *time_base)
+{
+    _time_base = time_base;
+}
+
+/**
+ * @brief Sets the poll interval used while tracking.
+ */
+void NTPSyncMonitor::setPollInterval(unsigned long poll_ms)
+{
+    if (poll_ms != 0)
+        _poll_ms.store(poll_ms, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Reports a sample that has passed the checks of the client.
+ * 
+ * @param delay Round-trip delay of the exchange in seconds.
+ * @param rootdelay Root delay of the server in seconds.
+ * @param rootdisp Root dispersion of the server in seconds.
+ */
+void NTPSyncMonitor::sampleReceived(float delay, float rootdelay, float rootdisp)
+{
+    sampleReceived(delay, rootdelay, rootdisp, millis());
+}
+
+void NTPSyncMonitor::sampleReceived(float delay, float rootdelay, float rootdisp, unsigned long now_ms)
+{
+    // A server that far away is no help.
+    float distance = rootDistance(delay, rootdelay, rootdisp);
+    if (distance > MAXDIST)
+    {
+        queryFailed();
+        return;
+    }
+    // Coming out of holdover or failure starts a new burst.
+    sync_state before = state(now_ms);
+    uint16_t good = ((before == IBURST) || (before == TRACKING)) ? _good_samples.load(std::memory_order_relaxed) : 0;
+    if (good < UINT16_MAX)
+        good++;
+    _distance.store(distance, std::memory_order_relaxed);
+    _last_good_ms.store(now_ms, std::memory_order_relaxed);
+    _failures.store(0, std::memory_order_relaxed);
+    _good_samples.store(good, std::memory_order_relaxed);
+    _ever_synced.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Root distance of a sample like RFC 5905 A.5.5.2 computes it, in seconds.
+ * 
+ * Samples beyond MAXDIST are dropped.
+ */
+float NTPSyncMonitor::rootDistance(float delay, float rootdelay, float rootdisp)
+{
+    return (rootdelay + delay) / 2.0f + rootdisp;
+}
+
+/**
+ * @brief Reports a query that has not given a good sample.
+ */
+void NTPSyncMonitor::queryFailed()
+{
+    uint16_t failures = _failures.load(std::memory_order_relaxed);
+    if (failures < UINT16_MAX)
+        _failures.store(failures + 1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Back to UNSYNCHRONIZED, e.g. after the server has been changed.
+ */
+void NTPSyncMonitor::reset()
+{
+    _ever_synced.store(false, std::memory_order_relaxed);
+    _good_samples.store(0, std::memory_order_relaxed);
+    _failures.store(0, std::memory_order_relaxed);
+    _distance.store(0.0f, std::memory_order_relaxed);
+}
+
+NTPSyncMonitor::sync_state NTPSyncMonitor::state() const
+{
+    return state(millis());
+}
+
+/**
+ * @brief The state at the given millis().
+ */
+NTPSyncMonitor::sync_state NTPSyncMonitor::state(unsigned long now_ms) const
+{
+    if (!_ever_synced.load(std::memory_order_acquire))
+        return (_failures.load(std::memory_order_relaxed) >= MAX_STARTUP_FAILURES) ? FAILED : UNSYNCHRONIZED;
+    unsigned long age_ms = now_ms - _last_good_ms.load(std::memory_order_relaxed);
+    unsigned long poll_ms = _poll_ms.load(std::memory_order_relaxed);
+    if (age_ms <= HOLDOVER_POLLS * poll_ms)
+    {
+        uint16_t good = _good_samples.load(std::memory_order_relaxed);
+        return (good < IBURST_SAMPLES) ? IBURST : TRACKING;
+    }
+    return (maxError(now_ms) <= MAX_ERROR) ? HOLDOVER : FAILED;
+}
+
+float NTPSyncMonitor::maxError() const
+{
+    return maxError(millis());
+}
+
+/**
+ * @brief Error bound of the synchronized time in seconds at the given millis().
+ * 
+ * With a bound time base this is its estimate, so the monitor and the time base tell the same
+ * bound.  Else it is the root distance of the last good sample plus what the local clock may
+ * have drifted since then with PHI.  Without a good sample it is infinite.
+ */
+float NTPSyncMonitor::maxError(unsigned long now_ms) const
+{
+    if (!_ever_synced.load(std::memory_order_acquire))
+        return INFINITY;
+    if ((_time_base != nullptr) && _time_base->valid())
+    {
+        // now_ms may lie ahead of or behind millis().
+        int64_t local_us = NTPTimeBase::localMicros() + (int64_t)(long)(now_ms - millis()) * 1000;
+        return _time_base->estimateAt(local_us).max_error;
+    }
+    unsigned long age_ms = now_ms - _last_good_ms.load(std::memory_order_relaxed);
+    return _distance.load(std::memory_order_relaxed) + PHI * (age_ms / 1e3f);
+}
+
+/**
+ * @brief All of it at once.
+ */
+NTPSyncMonitor::sync_status NTPSyncMonitor::status() const
+{
+    unsigned long now_ms = millis();
+    sync_status status;
+    status.state = state(now_ms);
+    status.max_error = maxError(now_ms);
+    status.age_ms = _ever_synced.load(std::memory_order_acquire) ? now_ms - _last_good_ms.load(std::memory_order_relaxed) : 0;
+    status.good_samples = _good_samples.load(std::memory_order_relaxed);
+    status.failures = _failures.load(std::memory_order_relaxed);
+    return status;
+}
+
+/**
+ * @brief Milliseconds until the next query should be made.
+ * 
+ * Quick while the burst is collecting samples, the poll interval while tracking.  Failures double
+ * it up to 16 poll intervals, so unreachable servers are not hammered.
+ */
+unsigned long NTPSyncMonitor::pollInterval() const
+{
+    unsigned long poll_ms = _poll_ms.load(std::memory_order_relaxed);
+    uint16_t failures = _failures.load(std::memory_order_relaxed);
+    if (failures == 0)
+        return (state() == IBURST) ? IBURST_POLL_MS : poll_ms;
+    unsigned long base = _ever_synced.load(std::memory_order_relaxed) ? poll_ms : IBURST_POLL_MS;
+    unsigned int shift = (failures > 4) ? 4 : failures;
+    return base << shift;
+}
+
+/**
+ * @brief Tells whether the time can be trusted: IBURST, TRACKING or HOLDOVER.
+ */
+bool NTPSyncMonitor::synchronized() const
+{
+    sync_state now = state();
+    return (now == IBURST) || (now == TRACKING) || (now == HOLDOVER);
+}
+
+/**
+ * @brief Name of the state for logging.
+ */
+const char *NTPSyncMonitor::stateName(sync_state state)
+{
+    switch (state)
+    {
+    case UNSYNCHRONIZED:
+        return "unsynchronized";
+    case IBURST:
+        return "iburst";
+    case TRACKING:
+        return "tracking";
+    case HOLDOVER:
+        return "holdover";
+    case FAILED:
+        return "failed";
+    }
+    return "unknown";
+}
@@ -0,0 +1,92 @@
+/**
+ * @file SyncMonitor.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "NTPClock.h"
+#include <atomic>
+#include <cstdbool>
+#include <cstdint>
+
+/**
+ * @brief Tells how well the client is synchronized.
+ * 
+ * The client reports every query outcome.  From that the monitor derives the state:
+ * 
+ * - UNSYNCHRONIZED  No good sample yet.
+ * - IBURST          Got a first good sample, collecting IBURST_SAMPLES at IBURST_POLL_MS.
+ * - TRACKING        The last good sample is not older than HOLDOVER_POLLS poll intervals.
+ * - HOLDOVER        Samples are missing.  The time is still good within maxError().  With a
+ *                   time base bound by bind() that is its estimate(), else it grows with the
+ *                   frequency tolerance PHI.
+ * - FAILED          The error bound has passed MAX_ERROR or there has never been a good sample in
+ *                   MAX_STARTUP_FAILURES tries.
+ * 
+ * Leaving HOLDOVER or FAILED takes a new burst.  Samples with a root distance beyond MAXDIST
+ * count as failures.  Time driven transitions are evaluated when asked, so state() is a few loads
+ * and a compare and safe from any task.  pollInterval() tells when the next query is due, so the
+ * firmware does not sync more often than needed.
+ */
+class NTPSyncMonitor
+{
+public:
+    enum sync_state : uint8_t
+    {
+        UNSYNCHRONIZED,
+        IBURST,
+        TRACKING,
+        HOLDOVER,
+        FAILED
+    };
+
+    struct sync_status
+    {
+        sync_state state;
+        float max_error;          ///< error bound of the synchronized time in seconds
+        unsigned long age_ms;     ///< milliseconds since the last good sample
+        uint16_t good_samples;    ///< good samples since synchronization has been gained
+        uint16_t failures;        ///< failed queries since the last good sample
+    };
+
+    static constexpr uint8_t IBURST_SAMPLES = 4;              ///< Good samples before tracking
+    static constexpr unsigned long IBURST_POLL_MS = 2000UL;   ///< 2 s like the iburst of RFC 5905
+    static constexpr uint8_t HOLDOVER_POLLS = 3;              ///< Missed polls before holdover
+    static constexpr uint16_t MAX_STARTUP_FAILURES = 8;       ///< Failures before the first sample
+    static constexpr float MAXDIST = 1.5f;                    ///< distance threshold (s) of RFC 5905 A.1.1
+    static constexpr float MAX_ERROR = 1.0f;                  ///< holdover ends beyond this error (s)
+    static constexpr float PHI = 15e-6f;                      ///< frequency tolerance (15 ppm)
+
+    void bind(const NTPTimeBase *time_base);
+    void setPollInterval(unsigned long poll_ms);
+    void sampleReceived(float delay, float rootdelay, float rootdisp);
+    void sampleReceived(float delay, float rootdelay, float rootdisp, unsigned long now_ms);
+    void queryFailed();
+    void reset();
+
+    sync_state state() const;
+    sync_state state(unsigned long now_ms) const;
+    float maxError() const;
+    float maxError(unsigned long now_ms) const;
+    sync_status status() const;
+    unsigned long pollInterval() const;
+    bool synchronized() const;
+    static const char *stateName(sync_state state);
+    static float rootDistance(float delay, float rootdelay, float rootdisp);
+
+private:
+    std::atomic<uint16_t> _good_samples{0};
+    std::atomic<uint16_t> _failures{0};
+    std::atomic<unsigned long> _last_good_ms{0};
+    std::atomic<float> _distance{0.0f};
+    std::atomic<unsigned long> _poll_ms{64000UL};
+    std::atomic<bool> _ever_synced{false};
+    const NTPTimeBase *_time_base = nullptr;
+};
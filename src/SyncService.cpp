@@ -0,0 +1,253 @@
+/**
+ * @file SyncService.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#include "SyncService.h"
+
+#if defined(ESP32)
+#include <cerrno>
+#include <type_traits>
+
+// The mailbox copies samples with memcpy.
+static_assert(std::is_trivially_copyable<NTPClient::ntp_sample>::value, "ntp_sample must be trivially copyable");
+
+/**
+ * @brief Creates the service for the given client.
+ * 
+ * @param client The client to be kept synchronized.  Call its begin() first.  It must outlive the service.
+ */
+NTPSyncService::NTPSyncService(NTPClient &client) : _client(client)
+{
+}
+
+NTPSyncService::~NTPSyncService()
+{
+    end();
+    if (_mailbox != nullptr)
+        vQueueDelete(_mailbox);
+    if (_events != nullptr)
+        vEventGroupDelete(_events);
+}
+
+/**
+ * @brief Starts the task.  The first query is made at once.
+ * 
+ * @param poll_ms Milliseconds between two successful queries.
+ * @param priority Priority of the task.  Keep it low, there is nothing urgent about it.
+ * @param stack_size Stack size of the task in bytes.
+ * @param core Core to pin the task to or tskNO_AFFINITY.
+ * @return true if the task is running, false if something went wrong.  You can get information by
+ * reading the errno variable.
+ */
+bool NTPSyncService::begin(unsigned long poll_ms, UBaseType_t priority, uint32_t stack_size, BaseType_t core)
+{
+    if (poll_ms == 0)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (_task != nullptr)
+    {
+        // Already running.
+        errno = EALREADY;
+        return false;
+    }
+    if (_mailbox == nullptr)
+        _mailbox = xQueueCreate(1, sizeof(NTPClient::ntp_sample));
+    if (_events == nullptr)
+        _events = xEventGroupCreate();
+    if ((_mailbox == nullptr) || (_events == nullptr))
+    {
+        // Out of memory.
+        errno = ENOMEM;
+        return false;
+    }
+    _poll_ms = poll_ms;
+    _client.syncMonitor().setPollInterval(poll_ms);
+    xEventGroupClearBits(_events, SYNCED_BIT | FAILED_BIT | STOPPED_BIT);
+    if (xTaskCreatePinnedToCore(task_entry, "sntp", stack_size, this, priority, &_task, core) != pdPASS)
+    {
+        // Out of memory.
+        _task = nullptr;
+        errno = ENOMEM;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stops the task and waits until it has ended.
+ */
+void NTPSyncService::end()
+{
+    if (_task == nullptr)
+        return;
+    xTaskNotify(_task, NOTIFY_STOP, eSetBits);
+    xEventGroupWaitBits(_events, STOPPED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    _task = nullptr;
+}
+
+/**
+ * @brief The latest successful sample.
+ * 
+ * @param[out] sample Receives the sample.
+ * @param wait Ticks to wait for the first sample if there is none yet.
+ * @return true if there is a sample, false if not.
+ */
+bool NTPSyncService::latest(NTPClient::ntp_sample *sample, TickType_t wait) const
+{
+    if ((sample == nullptr) || (_mailbox == nullptr))
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (xQueuePeek(_mailbox, sample, wait) != pdTRUE)
+    {
+        // No data available.
+        errno = ENODATA;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Event group holding SYNCED_BIT, FAILED_BIT and STOPPED_BIT.  Valid after begin().
+ */
+EventGroupHandle_t NTPSyncService::events() const
+{
+    return _events;
+}
+
+/**
+ * @brief Makes the task query now instead of waiting for the next poll.
+ */
+void NTPSyncService::syncNow()
+{
+    if (_task != nullptr)
+        xTaskNotify(_task, NOTIFY_SYNC_NOW, eSetBits);
+}
+
+/**
+ * @brief Tells the task a datagram has arrived, so it does not have to wait for the next tick.
+ */
+void NTPSyncService::notifyReceive()
+{
+    if (_task != nullptr)
+        xTaskNotify(_task, NOTIFY_RECEIVE, eSetBits);
+}
+
+/**
+ * @brief Same as notifyReceive() for interrupt handlers.
+ */
+void NTPSyncService::notifyReceiveFromISR(BaseType_t *higher_priority_task_woken)
+{
+    if (_task != nullptr)
+        xTaskNotifyFromISR(_task, NOTIFY_RECEIVE, eSetBits, higher_priority_task_woken);
+}
+
+//********************************************************************
+// protected section
+//********************************************************************
+
+void NTPSyncService::task_entry(void *self)
+{
+    static_cast<NTPSyncService *>(self)->run();
+    xEventGroupSetBits(static_cast<NTPSyncService *>(self)->_events, STOPPED_BIT);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief The poll schedule.
+ * 
+ * The sync monitor of the client sets the pace: a quick burst until the first samples are in,
+ * then every _poll_ms.  After failures the interval grows up to MAX_POLL_MS, so unreachable or
+ * rate limiting (KoD RATE) servers are not hammered.
+ */
+void NTPSyncService::run()
+{
+    for (;;)
+    {
+        NTPClient::ntp_sample sample;
+        if (wait_for_reply(&sample) == true)
+        {
+            xQueueOverwrite(_mailbox, &sample);
+            xEventGroupClearBits(_events, FAILED_BIT);
+            xEventGroupSetBits(_events, SYNCED_BIT);
+        }
+        else
+        {
+            if (errno == ECANCELED)
+                return;
+            xEventGroupClearBits(_events, SYNCED_BIT);
+            xEventGroupSetBits(_events, FAILED_BIT);
+        }
+        unsigned long interval = _client.syncMonitor().pollInterval();
+        if (interval > MAX_POLL_MS)
+            interval = MAX_POLL_MS;
+        if (sleep(interval) & NOTIFY_STOP)
+            return;
+    }
+}
+
+/**
+ * @brief Runs one query, sleeping on the task notification while the reply is outstanding.
+ * 
+ * @return true if ok, false if not.  errno is ECANCELED if the service is to stop.
+ */
+bool NTPSyncService::wait_for_reply(NTPClient::ntp_sample *sample)
+{
+    if (_client.startQuery() == false)
+    {
+        // Error code has been set.
+        return false;
+    }
+    for (;;)
+    {
+        uint32_t notified = 0;
+        xTaskNotifyWait(0, NOTIFY_RECEIVE | NOTIFY_STOP, &notified, 1);
+        if (notified & NOTIFY_STOP)
+        {
+            _client.cancelQuery();
+            errno = ECANCELED;
+            return false;
+        }
+        if (_client.pollQuery(sample) == true)
+            return true;
+        // EALREADY: another task holds the client, our query is still pending.
+        if ((errno != EINPROGRESS) && (errno != EALREADY))
+            return false;
+    }
+}
+
+/**
+ * @brief Sleeps until the next poll, syncNow() or end().
+ * 
+ * @return The notification bits that ended the sleep, 0 on timeout.
+ */
+uint32_t NTPSyncService::sleep(unsigned long ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    TickType_t start = xTaskGetTickCount();
+    for (;;)
+    {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= ticks)
+            return 0;
+        // Late receive notifications do not end the sleep.
+        uint32_t notified = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &notified, ticks - elapsed) == pdTRUE &&
+            (notified & (NOTIFY_SYNC_NOW | NOTIFY_STOP)))
+            return notified;
+    }
+}
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file SyncService.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-11
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+// The service needs FreeRTOS as it comes with the ESP32 Arduino core.
+#if defined(ESP32)
+
+#include "ntpclient.h"
+#include <cstdbool>
+#include <cstdint>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+/**
+ * @brief Keeps a NTPClient synchronized from a FreeRTOS task of its own.
+ * 
+ * The task owns the client and runs the poll schedule, so loop() and all other tasks never block
+ * on the network.  Results are published
+ * - as the latest sample in a one element queue (mailbox), read it with latest(), and
+ * - as bits of an event group, wait for SYNCED_BIT to know the time is there.
+ * 
+ * While waiting for a reply the task sleeps on its task notification.  notifyReceive() wakes it
+ * at once, e.g. from the receive callback of a transport.  Without such a callback it looks for
+ * the reply once per tick.
+ * 
+ * Do not use the client from other tasks while the service is running.
+ */
+class NTPSyncService
+{
+public:
+    static constexpr EventBits_t SYNCED_BIT = BIT0;  ///< Set while the last query has been successful.
+    static constexpr EventBits_t FAILED_BIT = BIT1;  ///< Set while the last query has failed.
+    static constexpr EventBits_t STOPPED_BIT = BIT2; ///< Set when the task has ended.
+    static constexpr unsigned long DEFAULT_POLL_MS = 64000UL; ///< 2^6 s like the minimum poll of RFC 5905
+    static constexpr unsigned long MAX_POLL_MS = 1024000UL;   ///< Back-off limit after failures
+
+    explicit NTPSyncService(NTPClient &client);
+    ~NTPSyncService();
+    bool begin(unsigned long poll_ms = DEFAULT_POLL_MS, UBaseType_t priority = 1, uint32_t stack_size = 4096,
+               BaseType_t core = tskNO_AFFINITY);
+    void end();
+    bool latest(NTPClient::ntp_sample *sample, TickType_t wait = 0) const;
+    EventGroupHandle_t events() const;
+    void syncNow();
+    void notifyReceive();
+    void notifyReceiveFromISR(BaseType_t *higher_priority_task_woken);
+
+protected:
+    // Task notification bits.
+    static constexpr uint32_t NOTIFY_RECEIVE = 1UL << 0;
+    static constexpr uint32_t NOTIFY_SYNC_NOW = 1UL << 1;
+    static constexpr uint32_t NOTIFY_STOP = 1UL << 2;
+
+    static void task_entry(void *self);
+    void run();
+    bool wait_for_reply(NTPClient::ntp_sample *sample);
+    uint32_t sleep(unsigned long ms);
+
+private:
+    NTPClient &_client;
+    TaskHandle_t _task = nullptr;
+    QueueHandle_t _mailbox = nullptr;
+    EventGroupHandle_t _events = nullptr;
+    unsigned long _poll_ms = DEFAULT_POLL_MS;
+};
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * @file UdpSocket.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include "UdpSocket.h"
+
+/**
+ * @brief NTP server name.
+ */
+String NTPUdpSocket::serverName() const
+{
+    return _server_name_str;
+}
+
+/**
+ * @brief Sets the NTP server to use.  Its name is resolved with the next exchange.
+ */
+void NTPUdpSocket::setServerName(const char *ntp_server_name)
+{
+    _server_name_str = ntp_server_name;
+    _server_ip_valid = false;
+}
+
+/**
+ * @brief The address the server name has been resolved to, or an unset address if there was no
+ * successful resolution yet.
+ */
+IPAddress NTPUdpSocket::serverAddress() const
+{
+    return _server_ip_valid ? _server_ip : IPAddress();
+}
+
+/**
+ * @brief Resolves the server name unless its address is already known.
+ * @return true if the server address is available else false.
+ * 
+ * Passing the name to WiFiUDP::beginPacket() would do a blocking DNS lookup on every
+ * single request.  So the name is resolved once and the address is kept until the name
+ * changes or the server stops answering.
+ * 
+ * If something goes wrong this functions sets the errno variable.
+ */
+bool NTPUdpSocket::resolveServer()
+{
+    if (_server_ip_valid)
+    {
+        return true;
+    }
+    if (WiFi.hostByName(_server_name_str.c_str(), _server_ip) != 1)
+    {
+        // Cannot resolve DNS name of server.
+        errno = EADDRNOTAVAIL;
+        return false;
+    }
+    _server_ip_valid = true;
+    return true;
+}
+
+/**
+ * @brief Forgets the server address, e.g. because it did not answer.  The next exchange resolves
+ * the name again and may get another member of a server pool.
+ */
+void NTPUdpSocket::forgetServer()
+{
+    _server_ip_valid = false;
+}
+
+/**
+ * @brief Uses a fixed local port.  The socket moves to it with the next open().
+ */
+void NTPUdpSocket::setLocalPort(uint16_t port)
+{
+    close();
+    _local_port = port;
+    _port_rotation = 0;
+}
+
+/**
+ * @brief Uses random ephemeral ports, moving to a new one after every exchanges_per_port
+ * exchanges, 0 to keep the first one.
+ */
+void NTPUdpSocket::setEphemeralPorts(unsigned int exchanges_per_port)
+{
+    close();
+    _local_port = 0;
+    _port_rotation = exchanges_per_port;
+}
+
+/**
+ * @brief The fixed local port or 0 if ephemeral ports are to be used.
+ */
+uint16_t NTPUdpSocket::localPortSetting() const
+{
+    return _local_port;
+}
+
+/**
+ * @brief Local UDP port, 0 if the socket is not open.
+ */
+uint16_t NTPUdpSocket::localPort() const
+{
+    return _socket_port;
+}
+
+/**
+ * @brief Assures the network resources are avaible.
+ * @return true if everything is ok else false.
+ * 
+ * If something goes wrong this functions sets the errno variable.
+ */
+bool NTPUdpSocket::open()
+{
+    // Assure the network resources are avaible.
+    // a.) Missing network connection is a fatal error (ENETDOWN).
+    // b.) We might be able to cleanup an occupied UDP port by
+    // calling stop(). But this seems to produce a memory leak
+    // these days because of missing delete operator (EISCONN).
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        // Unable to handle this here.  Giving up.
+        errno = ENETDOWN;
+        return false;
+    }
+    // An ephemeral port is given up after its share of exchanges.
+    if ((_socket_port != 0) && (_local_port == 0) && (_port_rotation != 0) && (_port_exchanges >= _port_rotation))
+    {
+        close();
+    }
+    if (_socket_port != 0)
+    {
+        return true;
+    }
+    // The socket is opened on the fixed port or on a random ephemeral port.  A taken ephemeral
+    // port is retried with another one.
+    uint16_t port = _local_port;
+    bool opened = false;
+    if (port != 0)
+    {
+        opened = _socket.begin(port);
+    }
+    else
+    {
+        for (unsigned int tries = 0; !opened && (tries < 8U); tries++)
+        {
+            port = (uint16_t)random(EPHEMERAL_FIRST, (long)EPHEMERAL_LAST + 1);
+            opened = _socket.begin(port);
+        }
+    }
+    if (!opened)
+    {
+        // Unwilling to handle this here, because of comment "b.)".  Giving up.
+        errno = EISCONN;
+        return false;
+    }
+    _socket_port = port;
+    _port_exchanges = 0;
+    return true;
+}
+
+/**
+ * @brief Closes the socket.  The next open() opens a new one.
+ */
+void NTPUdpSocket::close()
+{
+    if (_socket_port != 0)
+    {
+        _socket.stop();
+        _socket_port = 0;
+    }
+}
+
+/**
+ * @brief Sends a request to the server.  Call open() first.
+ * @return true if the request has left, false if not.  errno tells why.
+ */
+bool NTPUdpSocket::send(const void *packet, size_t size)
+{
+    if (resolveServer() == false)
+    {
+        // Error code has been set.
+        return false;
+    }
+    // Throw away late replies of abandoned exchanges, they would be taken for the reply to this one.
+    while (_socket.parsePacket() != 0)
+    {
+        _socket.flush();
+    }
+
+    // Execute server request.
+    if ((_socket.beginPacket(_server_ip, NTP_SERVER_PORT)) != true)
+    {
+        // Server address is not reachable.
+        errno = EADDRNOTAVAIL;
+        return false;
+    }
+    if ((_socket.write((const uint8_t *)packet, size)) != size)
+    {
+        // The I/O buffer was lost or too small to hold this amount of data.
+        errno = EOVERFLOW;
+        return false;
+    }
+    if ((_socket.endPacket()) != true)
+    {
+        // The packet has not been sent correctly: Dubious error / Don't know why.
+        errno = EIO;
+        return false;
+    }
+    _tx_micros = micros();
+    _port_exchanges++;
+    return true;
+}
+
+/**
+ * @brief Takes the reply if it is there.
+ * @return true if a reply has been read, false if not.  errno is EINPROGRESS if there is just nothing yet.
+ */
+bool NTPUdpSocket::poll(void *packet, size_t size)
+{
+    int rply_size = _socket.parsePacket();
+    if (rply_size == 0)
+    {
+        // Nothing arrived yet.
+        errno = EINPROGRESS;
+        return false;
+    }
+    _rx_micros = micros();
+    if (rply_size < (int)size)
+    {
+        // The datagram is too small to be valid.
+        _socket.flush();
+        errno = EPROTONOSUPPORT;
+        return false;
+    }
+    if (_socket.read((char *)packet, size) != (int)size)
+    {
+        // The I/O buffer was lost or too small to hold this amount of data.
+        errno = EOVERFLOW;
+        return false;
+    }
+    // Finish reading the current packet
+    _socket.flush();
+    return true;
+}
+
+/**
+ * @brief The socket, e.g. for transports adding something of their own.
+ */
+WiFiUDP &NTPUdpSocket::datagram()
+{
+    return _socket;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file UdpSocket.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#if defined(ESP32)
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+#include <WiFiUdp.h>
+#include <Arduino.h>
+#include <WString.h>
+#include <cerrno>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The WiFiUDP side of an exchange with the server, without virtual functions.
+ * 
+ * It keeps the server name and its resolved address, opens the socket on the fixed or a random
+ * ephemeral port, sends a request after throwing away late replies, and reads a reply.  The
+ * moments the request has left and the reply has been seen are taken with micros().
+ * 
+ * NTPMessageTransport and NTPUdpTransport both do their exchanges through it.  What an exchange
+ * is, whether it is pending and when it has timed out is up to them.
+ */
+class NTPUdpSocket final
+{
+public:
+    // Q.v. http://www.iana.org/assignments/port-numbers
+    static constexpr uint16_t NTP_SERVER_PORT = 123U;     ///< Server UDP port given by IANA.
+    static constexpr uint16_t DEFAULT_LOCAL_PORT = 8123U; ///< Client UDP port after my fancy.
+    static constexpr uint16_t EPHEMERAL_FIRST = 49152U;   ///< Dynamic port range of IANA, q.v. RFC 6335, 6.
+    static constexpr uint16_t EPHEMERAL_LAST = 65535U;
+
+    NTPUdpSocket() = default;
+    NTPUdpSocket(const NTPUdpSocket &) = delete;
+    NTPUdpSocket &operator=(const NTPUdpSocket &) = delete;
+
+    String serverName() const;
+    void setServerName(const char *ntp_server_name);
+    IPAddress serverAddress() const;
+    bool resolveServer();
+    void forgetServer();
+    void setLocalPort(uint16_t port);
+    void setEphemeralPorts(unsigned int exchanges_per_port);
+    uint16_t localPortSetting() const;
+    uint16_t localPort() const;
+    bool open();
+    void close();
+    bool send(const void *packet, size_t size);
+    bool poll(void *packet, size_t size);
+    WiFiUDP &datagram();
+    unsigned long txMicros() const { return _tx_micros; }
+    unsigned long rxMicros() const { return _rx_micros; }
+
+    /**
+     * @brief Calls poll() once a millisecond until it has a reply, fails or timeout has passed.
+     * 
+     * @param poll Callable returning true with a reply, else false and errno EINPROGRESS if there
+     * is just nothing yet.
+     * @param timeout Milliseconds to wait.
+     * @return true if there is a reply, false if not.  errno is ETIMEDOUT if there was none in time.
+     */
+    template <class Poll>
+    static bool receive(Poll poll, unsigned long timeout)
+    {
+        for (unsigned long ms_cycles = 0; ms_cycles < timeout; ms_cycles++)
+        {
+            if (poll() == true)
+                return true;
+            if (errno != EINPROGRESS)
+            {
+                // Unusable reply.  Error code has been set.
+                return false;
+            }
+            delay(1UL);
+        }
+        // No reply in time.
+        errno = ETIMEDOUT;
+        return false;
+    }
+
+private:
+    WiFiUDP _socket;
+    String _server_name_str;
+    IPAddress _server_ip;     ///< Resolved address of _server_name_str, valid if _server_ip_valid.
+    bool _server_ip_valid = false;
+    uint16_t _local_port = DEFAULT_LOCAL_PORT; ///< Fixed local port, 0 for ephemeral ports.
+    unsigned int _port_rotation = 0;  ///< Exchanges on one ephemeral port, 0 to keep it.
+    unsigned int _port_exchanges = 0; ///< Exchanges on the open port.
+    uint16_t _socket_port = 0;        ///< Port the socket is bound to, 0 if closed.
+    unsigned long _tx_micros = 0;     ///< micros() when the last request has been sent.
+    unsigned long _rx_micros = 0;     ///< micros() when the last reply has been seen.
+};
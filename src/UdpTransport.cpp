@@ -0,0 +1,120 @@
+/**
+ * @file UdpTransport.cpp
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#include "UdpTransport.h"
+#include <Arduino.h>
+#include <cerrno>
+
+/**
+ * @brief Sets the NTP server to use.  Its name is resolved with the next exchange.
+ */
+void NTPUdpTransport::setServerName(const char *ntp_server_name)
+{
+    _udp.setServerName(ntp_server_name);
+}
+
+/**
+ * @brief Uses another fixed local UDP port.  The socket is opened on it with the next exchange.
+ * 
+ * @return true if ok, false if the port is 0 (errno is EINVAL).
+ */
+bool NTPUdpTransport::setLocalPort(uint16_t port)
+{
+    if (port == 0)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    cancelExchange();
+    _udp.setLocalPort(port);
+    return true;
+}
+
+/**
+ * @brief Sends the request and waits for the reply, q.v. NTPMessageTransport::packetExchange().
+ */
+bool NTPUdpTransport::packetExchange(ntp_packet *packet, unsigned long timeout)
+{
+    if ((packet == nullptr) || (timeout == 0))
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (beginExchange(packet) == false)
+    {
+        // Error code has been set.
+        return false;
+    }
+    _exchange_pending = false;
+    if (NTPUdpSocket::receive([this, packet]() { return _udp.poll(packet, sizeof(*packet)); }, timeout) == false)
+    {
+        // The server did not answer.  The next exchange resolves the name again.  Error code has been set.
+        _udp.forgetServer();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends the request without waiting for the reply, q.v. NTPMessageTransport::beginExchange().
+ */
+bool NTPUdpTransport::beginExchange(ntp_packet *packet)
+{
+    if (packet == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if ((_udp.open() == false) || (_udp.send(packet, sizeof(*packet)) == false))
+    {
+        // Error code has been set.
+        return false;
+    }
+    _exchange_pending = true;
+    return true;
+}
+
+/**
+ * @brief Looks for the reply without blocking, q.v. NTPMessageTransport::pollExchange().
+ */
+bool NTPUdpTransport::pollExchange(ntp_packet *packet)
+{
+    if ((packet == nullptr) || !_exchange_pending)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (_udp.poll(packet, sizeof(*packet)) == false)
+    {
+        if (errno != EINPROGRESS)
+            _exchange_pending = false;
+        return false;
+    }
+    _exchange_pending = false;
+    return true;
+}
+
+/**
+ * @brief Abandons a pending exchange.  The next exchange resolves the name again.
+ */
+void NTPUdpTransport::cancelExchange()
+{
+    if (_exchange_pending)
+    {
+        _exchange_pending = false;
+        _udp.forgetServer();
+    }
+}
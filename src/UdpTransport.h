@@ -0,0 +1,52 @@
+/**
+ * @file UdpTransport.h
+ * @author Michael Hoffmann
+ * @author Dieter Zumkehr
+ * @brief 
+ * @version 0.9.0
+ * @date 2021-11-10
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+#pragma once
+
+#include "MessageTransport.h"
+#include "UdpSocket.h"
+#include <WString.h>
+#include <cstdbool>
+#include <cstdint>
+
+/**
+ * @brief Plain WiFiUDP transport without virtual functions, the default of NTPBasicClient.
+ * 
+ * It does the same exchange as NTPMessageTransport on its default settings, through the same
+ * NTPUdpSocket: one socket on a fixed local port, the server name resolved once, micros() taken
+ * when the request has left and when the reply has been seen.  Nothing can be overridden, there
+ * is no capture sink and no rotation of ephemeral ports.  So the calls of NTPBasicClient are
+ * resolved at compile time.
+ * 
+ * \sa NTPMessageTransport for everything else.
+ */
+class NTPUdpTransport final
+{
+public:
+    typedef NTPMessageTransport::ntp_packet ntp_packet;
+
+    NTPUdpTransport() = default;
+    NTPUdpTransport(const NTPUdpTransport &) = delete;
+    NTPUdpTransport &operator=(const NTPUdpTransport &) = delete;
+
+    void setServerName(const char *ntp_server_name);
+    bool setLocalPort(uint16_t port);
+    bool packetExchange(ntp_packet *packet, unsigned long timeout);
+    bool beginExchange(ntp_packet *packet);
+    bool pollExchange(ntp_packet *packet);
+    void cancelExchange();
+    unsigned long txMicros() const { return _udp.txMicros(); }
+    unsigned long rxMicros() const { return _udp.rxMicros(); }
+
+private:
+    NTPUdpSocket _udp;
+    bool _exchange_pending = false;
+};
@@ -16,6 +16,42 @@
 #include <cstdbool>
 #include <cstring>
 
+// The engine works on the bytes of ntp_packet.
+static_assert(NTPEngine::PACKET_SIZE == NTPMessageTransport::NTP_PACKET_SIZE, "engine and transport disagree on the packet size");
+
+/**
+ * @brief Creates a client talking to its server via WiFiUDP.
+ */
+NTPClient::NTPClient() : _ntp(&_own_ntp)
+{
+    _monitor.bind(&_time_base);
+#if defined(ESP32)
+    _flight_lock = xSemaphoreCreateMutex();
+#endif
+}
+
+/**
+ * @brief Creates a client using a transport of your choice.
+ * 
+ * @param transport The transport for the exchanges with the server, e.g. a NTPReplayTransport.
+ * It must outlive the client.
+ */
+NTPClient::NTPClient(NTPMessageTransport &transport) : _ntp(&transport)
+{
+    _monitor.bind(&_time_base);
+#if defined(ESP32)
+    _flight_lock = xSemaphoreCreateMutex();
+#endif
+}
+
+NTPClient::~NTPClient()
+{
+#if defined(ESP32)
+    if (_flight_lock != nullptr)
+        vSemaphoreDelete(_flight_lock);
+#endif
+}
+
 /**
  * @brief Use this first.
  * 
@@ -27,14 +63,14 @@
 void NTPClient::begin(const char *ntp_server_name)
 {
     if (ntp_server_name != nullptr)
-        _ntp.setServerName(ntp_server_name);
+        _ntp->setServerName(ntp_server_name);
     else
-        _ntp.setServerName(DEFAULT_NTP_SERVER);
+        _ntp->setServerName(DEFAULT_NTP_SERVER);
 }
 
 String NTPClient::serverName() const
 {
-    return _ntp.serverName();
+    return _ntp->serverName();
 }
 
 void NTPClient::setServerName(const char *ntp_server_name)
@@ -45,207 +81,652 @@ void NTPClient::setServerName(const char *ntp_server_name)
         errno = EINVAL;
         return;
     }
-    _ntp.setServerName(ntp_server_name);
+    _ntp->setServerName(ntp_server_name);
+}
+
+/**
+ * @brief The transport used by this client, e.g. to set its local port.
+ */
+NTPMessageTransport &NTPClient::transport()
+{
+    return *_ntp;
 }
 
 /**
  * @brief The time function returns the UTC current time stamp in Unix format.
  * 
  * @param tloc If tloc is not a null pointer, the return value is also assigned to the object it points to.
- * @param system_time The current time as far as it is known.  Leave it unused assumes 1. Jan. 1970Z00:00:00
  * @return time_t current time if ok, -1 if something went wrong.
+ * 
+ * It prints the outcome and waits for the next full second, which it returns.
  */
 time_t NTPClient::time(time_t *tloc)
 {
-    // NTP era 0 starts at 1. Jan .1900Z00:00.  If system time was given we can set the clock to an interim
-    // time.  This is a good idea, because it creates our UDP packets with non constant timestamps.  So the
-    // values Transmit Timestamp and Originate Timestamp can be distinguished from old packets arriving late.
-    // Not least this enables the "suggested check 3." as demanded in RFC 4330 "5. SNTP Client Operations".
-    time_t ntp_time = ERA_OFFSET0_1_JAN_1970 + 1637244065; // TODO: Offset added for testing purposes.
-
-    // On-wire protocol needs four timestamps called T1, T2, T3, T4.  You can find the On-Wire algorithm
-    // in RFC 4330, 5. SNTP Client Operations or at https://www.eecis.udel.edu/~mills/onwire.html.  T4 is
-    // the final arrive time at the client in relation to T1.  It will be deviated later from the values
-    // given by our system internal milliseconds clock.
-    NTPMessageTransport::tstamp64_t t1, t2, t3;
-    NTPMessageTransport::generateTstamp(&t1, ntp_time, 0.0);
-
-    // Make the exchange with the NTP server.  We want to know the elapsed time until we get our answer back
-    // so we count the milliseconds.  Our agreement is that we start our interaction at fraction 0.0s so it
-    // will be possible to calculate the offsets of communication delays later.
-    NTPMessageTransport::ntp_packet ntp_packet;
-    ntp_packet.xmt = t1;
-    unsigned long millis_start = millis();
-    if (on_wire_exchange(&ntp_packet) == false)
+    ntp_sample sample;
+    NTPStatus status = tryQuery(&sample);
+    if (!status)
     {
-        lastErrorString();
+        Serial.print(F("\n"));
+        Serial.print(F("Last error: "));
+        status.printTo(Serial);
+        Serial.println();
+        status.toErrno();
         return (time_t)-1LL;
     }
-    unsigned long millis_delta = millis() - millis_start;
-    millis_start = millis(); // Just want to correct the time the algorithm with its serial logger consumes.
-    t2 = ntp_packet.rec;     // Receive Timestamp measured by the server
-    t3 = ntp_packet.xmt;     // Transmit Timestamp when the server sent its message
-    // I like doing the computation on double variables.  As described in https://de.wikipedia.org/wiki/Doppelte_Genauigkeit
-    // we will have an approx accuracy of "52log10(2) approx 15.7 digits" for IEEE 754 52 bit fraction.
-    // E.g. this looks like 3846310349.xxxxx.  I.e. the error might be somewhere in the <=10 us area on
-    // a 64 bit real number.  Arduino AVR claims double but in my reminisce just uses 32 bit. If this
-    // is IEEE it should only have an accuracy of 6 digits (23log10(2) approx 6.9) and would not be
-    // sufficent for anything done here.
-    double t1d = NTPMessageTransport::getSeconds(t1) + 0.0; // Fraction 0.0 is given by agreement.
-    double t4d = t1d + millis_delta / 1e3; // Destination Timestamp: t1d + delay of exchange with server
-    double t2d = NTPMessageTransport::getSeconds(t2) + NTPMessageTransport::getFraction(t2);
-    double t3d = NTPMessageTransport::getSeconds(t3) + NTPMessageTransport::getFraction(t3);
-    double roundtrip_delay = (t4d - t1d) - (t3d - t2d);
-    double clock_offset = ((t2d - t1d) + (t3d - t4d)) / 2.0;
-    Serial.print(F("--> T1: "));
-    Serial.println(t1d);
-    Serial.print(F("--> T2: "));
-    Serial.println(t2d);
-    Serial.print(F("--> T3: "));
-    Serial.println(t3d);
-    Serial.print(F("--> T4: "));
-    Serial.println(t4d);
     Serial.print(F("--> Clock offset: "));
-    Serial.println(clock_offset);
+    Serial.println(sample.offset);
     Serial.print(F("--> Round-trip delay: "));
-    Serial.print(roundtrip_delay);
+    Serial.print(sample.delay * 1e3);
     Serial.println(F(" ms"));
-    // Now we can calculate the unix_time with a fraction part.  But our time system in the upper
+    // Now we have the unix_time with a fraction part.  But our time system in the upper
     // layers normally does not have any millisecond counter.  Now we try to offer a synchronization
     // against the NEXT full second.  Therefore the timestamp to be returned will give the next full
     // second.  We just need to fiddle away until the next second arrives by calling delay() and
     // then return.  Because delay does not do active waiting, it will not harm WiFi, Bluetooth and
     // other fragile good.  On the other hand that is not the most high-precision approach.
-    double unix_time_d = 1.0 + clock_offset + ntp_time - ERA_OFFSET0_1_JAN_1970 + (millis() - millis_start) / 1e3;
+    double unix_time_d = 1.0 + sample.unix_time + (millis() - sample.sync_millis) / 1e3;
     Serial.print(F("--> unix_time_d: "));
     Serial.println(unix_time_d);
     double unix_time_d_intpart;
     uint_least32_t sync_ms_delay = 1e3 - modf(unix_time_d, &unix_time_d_intpart) * 1e3;
     Serial.print(F("--> delta time: "));
-    Serial.print(millis() - millis_start);
+    Serial.print(millis() - sample.sync_millis);
     Serial.println(F(" ms"));
     delay(sync_ms_delay);
 
     time_t unix_time = (time_t)unix_time_d_intpart;
     if (tloc)
         *tloc = unix_time;
-    return (time_t)unix_time;
-    // TODO: Remind ERA_OFFSET1 -> secs_since_8_feb_2036
+    return unix_time;
 }
 
 /**
- * @brief Error reporting
+ * @brief Like time(), but tells the outcome by its return value instead of errno, and neither
+ * prints nor waits for the next full second.
  * 
- * @param error if nullptr the message will be printed on serial; if "String *" the message will be copied to the string.
+ * @param[out] tloc If tloc is not a null pointer, it receives the UTC current time stamp in Unix
+ * format, the seconds elapsed since the sample included.
+ * @return The status of this call.  On ESP32 it may be that of an exchange shared with other
+ * tasks, q.v. tryQuery().
  */
-void NTPClient::lastErrorString(String *error)
+NTPStatus NTPClient::tryTime(time_t *tloc)
 {
-    String error_str(strerror(errno));
+    ntp_sample sample;
+    NTPStatus status = tryQuery(&sample);
+    if (!status)
+        return status;
+    if (tloc)
+        *tloc = (time_t)floor(sample.unix_time + (millis() - sample.sync_millis) / 1e3);
+    return status;
+}
 
-    if (error == nullptr)
+/**
+ * @brief Measures the clock offset against the server without waiting for a full second.
+ * 
+ * @param[out] sample Receives the outcome of the exchange.  May be nullptr if only lastSample()
+ * is of interest.
+ * @return true if ok, false if something went wrong.  You can get information by reading the errno variable.
+ * 
+ * This is the query part of time() like "ntpdate -q" does it.  It does neither print nor delay.
+ */
+bool NTPClient::query(ntp_sample *sample)
+{
+    return tryQuery(sample).toErrno();
+}
+
+/**
+ * @brief Like query(), but tells the outcome by its return value instead of errno.
+ * 
+ * @param[out] sample Receives the outcome of the exchange.  May be nullptr.
+ * @return The status of this call, with the Kiss-o'-Death code if the server sent one.
+ * 
+ * On ESP32 tasks calling this while an exchange is in flight do not start their own one.  They
+ * wait for it and share its sample and status, so the server gets one request and every task
+ * waits one round-trip instead of one per task before it.  sync_millis and local_us of the
+ * sample tell each task how much time has elapsed since.  A pending query of startQuery() is
+ * joined the same way: its outcome is shared once the task polling it has finished it.  If it
+ * is not polled until its timeout this fails with ETIMEDOUT.  The task which has started it
+ * cannot wait for itself and gets EALREADY.  On ESP8266 there is only one caller at a time, a
+ * pending query fails this with EALREADY and all of this compiles away.
+ */
+NTPStatus NTPClient::tryQuery(ntp_sample *sample)
+{
+#if defined(ESP32)
+    // If an exchange has finished while we were waiting for the lock, it was in flight when we
+    // came.  Its outcome is as fresh as ours would be.
+    uint32_t generation = _flight_generation.load(std::memory_order_relaxed);
+    lock_flight(true);
+    // A query of startQuery() is in flight as well.  Its task polls it and finishes it.
+    while (_query_pending && (_query_task != xTaskGetCurrentTaskHandle()) &&
+           (_flight_generation.load(std::memory_order_relaxed) == generation) &&
+           (millis() - _query_start_millis < _query_timeout))
     {
-        Serial.print(F("\n"));
-        Serial.print(F("Last error: "));
-        Serial.println(error_str);
+        unlock_flight();
+        delay(1UL);
+        lock_flight(true);
+    }
+    NTPStatus status;
+    if (_flight_generation.load(std::memory_order_relaxed) != generation)
+    {
+        status = _flight_status;
+        if (status && sample)
+            *sample = _last_sample;
+    }
+    else if (_query_pending)
+    {
+        // Either our own query of startQuery() or one nobody polls.
+        status = NTPStatus::fromErrno(_query_task == xTaskGetCurrentTaskHandle() ? EALREADY : ETIMEDOUT);
     }
     else
     {
-        *error = error_str;
+        status = exchange_sample(sample);
+        finish_flight(status);
+    }
+    unlock_flight();
+    return status;
+#else
+    if (_query_pending)
+    {
+        // The transport waits for the reply of startQuery().
+        return NTPStatus::fromErrno(EALREADY);
     }
+    return exchange_sample(sample);
+#endif
 }
 
 /**
- * @brief Interchange of timestamps T1, T2, T3 and T4 like in "Basic Symmetric Mode" of RFC 5905.
+ * @brief Makes one exchange and takes its sample.  tryQuery() without the single flight, the
+ * caller holds the client.
+ */
+NTPStatus NTPClient::exchange_sample(ntp_sample *sample)
+{
+    // Make the exchange with the NTP server.  We want to know the elapsed time until we get our answer back.
+    // The transport stamps the moments the request left and the reply arrived with micros(), so name
+    // resolution and other local overhead do not end up in the round-trip.
+    NTPMessageTransport::ntp_packet ntp_packet;
+    _metrics.queryStarted();
+    NTPMessageTransport::tstamp64_t t1 = transmit_timestamp();
+    ntp_packet.xmt = t1;
+    NTPStatus status = on_wire_exchange(&ntp_packet);
+    if (!status)
+    {
+        query_failed(status);
+        return status;
+    }
+    status = take_sample(ntp_packet, t1);
+    if (status && sample)
+        *sample = _last_sample;
+    return status;
+}
+
+/**
+ * @brief Sends the request of startQuery().  The caller holds the client.
+ */
+NTPStatus NTPClient::start_query(unsigned long timeout)
+{
+    if (timeout == 0)
+    {
+        // Invalid argument.
+        return NTPStatus::fromErrno(EINVAL);
+    }
+    if (_query_pending)
+    {
+        // Only one query at a time.
+        return NTPStatus::fromErrno(EALREADY);
+    }
+    _metrics.queryStarted();
+    _query_t1 = transmit_timestamp();
+    _query_packet.xmt = _query_t1;
+    build_request(&_query_packet);
+    if (_ntp->beginExchange(&_query_packet) == false)
+    {
+        // Take the error code before anything else can change it.
+        NTPStatus status = NTPStatus::fromErrno(errno);
+        query_failed(status);
+        return status;
+    }
+    _query_start_millis = millis();
+    _query_timeout = timeout;
+    _query_pending = true;
+#if defined(ESP32)
+    _query_task = xTaskGetCurrentTaskHandle();
+#endif
+    return NTPStatus();
+}
+
+/**
+ * @brief Checks for the reply of startQuery().  The caller holds the client.
+ */
+NTPStatus NTPClient::poll_query(ntp_sample *sample)
+{
+    if (!_query_pending)
+    {
+        // There is nothing to poll for.
+        return NTPStatus::fromErrno(EINVAL);
+    }
+    NTPStatus status;
+    if (_ntp->pollExchange(&_query_packet) == false)
+    {
+        status = NTPStatus::fromErrno(errno);
+        if (status.code() == NTPStatus::IN_PROGRESS)
+        {
+            if (millis() - _query_start_millis < _query_timeout)
+                return status;
+            _ntp->cancelExchange();
+            status = NTPStatus::fromErrno(ETIMEDOUT);
+        }
+        _query_pending = false;
+        query_failed(status);
+    }
+    else
+    {
+        _query_pending = false;
+        status = check_reply(_query_packet, _query_t1);
+        if (!status)
+            query_failed(status);
+        else
+            status = take_sample(_query_packet, _query_t1);
+        if (status && sample)
+            *sample = _last_sample;
+    }
+    // Tasks which have joined the query get its outcome.
+    finish_flight(status);
+    return status;
+}
+
+/**
+ * @brief Abandons the query of startQuery().  The caller holds the client.
+ */
+void NTPClient::cancel_query()
+{
+    if (_query_pending)
+    {
+        _ntp->cancelExchange();
+        _query_pending = false;
+    }
+}
+
+/**
+ * @brief Hands the outcome of an exchange to the tasks waiting for it, q.v. tryQuery().  The
+ * caller holds the client.
+ */
+void NTPClient::finish_flight(const NTPStatus &status)
+{
+#if defined(ESP32)
+    _flight_status = status;
+    _flight_generation.fetch_add(1, std::memory_order_relaxed);
+#else
+    (void)status;
+#endif
+}
+
+/**
+ * @brief Takes the client for one exchange, q.v. tryQuery().
  * 
- * @param[in,out] packet The packet to be sent to the server which will be replaced by the packet received by the server.
- * @return true All is fine.
- * @return false In case of error.  You also can get information by reading the errno variable.
+ * @param wait Whether to wait for another task to give the client back.
+ * @return true if the client is ours until unlock_flight(), false if another task holds it.
+ */
+bool NTPClient::lock_flight(bool wait)
+{
+#if defined(ESP32)
+    if (_flight_lock == nullptr)
+        return true;
+    return xSemaphoreTake(_flight_lock, wait ? portMAX_DELAY : 0) == pdTRUE;
+#else
+    (void)wait;
+    return true;
+#endif
+}
+
+void NTPClient::unlock_flight()
+{
+#if defined(ESP32)
+    if (_flight_lock != nullptr)
+        xSemaphoreGive(_flight_lock);
+#endif
+}
+
+/**
+ * @brief Starts a query without waiting for the reply.
  * 
- * Q.v. https://www.eecis.udel.edu/~mills/onwire.html
+ * @param timeout Milliseconds to wait for the reply.
+ * @return true if the request has been sent, false if something went wrong.  You can get information by
+ * reading the errno variable.
  * 
+ * Call pollQuery() until it tells the query is finished.  Meanwhile loop() can do other things.
  */
-bool NTPClient::on_wire_exchange(NTPMessageTransport::ntp_packet *packet)
+bool NTPClient::startQuery(unsigned long timeout)
 {
-    if (packet == nullptr)
+    return tryStartQuery(timeout).toErrno();
+}
+
+/**
+ * @brief Like startQuery(), but tells the outcome by its return value instead of errno.
+ * 
+ * On ESP32 this fails with EALREADY while another task holds the client for an exchange.
+ */
+NTPStatus NTPClient::tryStartQuery(unsigned long timeout)
+{
+    if (lock_flight(false) == false)
     {
-        // Invalid argument.
-        errno = EINVAL;
-        return false;
+        // Another task is in the middle of an exchange.
+        return NTPStatus::fromErrno(EALREADY);
     }
+    NTPStatus status = start_query(timeout);
+    unlock_flight();
+    return status;
+}
 
-    // I am a client.  This is my request to my server.
-    // Doing this like described in RFC 4330 '4. Message Format' and '5. SNTP Client Operations'.
-    //
-    constexpr uint8_t LEAP_NO_WARNING = 0b00'000000; // Clients do not announce leap seconds
-    constexpr uint8_t NTP_VERSION_4 = 0b00'100'000;  // I want to use NTP protocol version 4
-    constexpr uint8_t MODE_CLIENT = 0b00000'011;     // I am a client
-    // Assembling client message
-    NTPMessageTransport::tstamp64_t xmt_bak = packet->xmt;
-    memset(packet, 0, sizeof(NTPMessageTransport::ntp_packet)); // Setting everything to zero / NIL
-    packet->li_vn_mode = LEAP_NO_WARNING | NTP_VERSION_4 | MODE_CLIENT;
-    packet->xmt = xmt_bak;
+/**
+ * @brief Checks for the reply of a query started by startQuery().
+ * 
+ * @param[out] sample Receives the outcome of the exchange.  May be nullptr.
+ * @return true if the query has finished successfully.  false if the query is still pending (errno is
+ * EINPROGRESS then, or EALREADY while another task holds the client) or has failed (errno tells
+ * why, ETIMEDOUT if there was no reply in time).
+ */
+bool NTPClient::pollQuery(ntp_sample *sample)
+{
+    return tryPollQuery(sample).toErrno();
+}
 
-    // Doing exchange with the NTP server.
-    constexpr unsigned long TIMEOUT = 1024UL;
-    if (_ntp.packetExchange(packet, TIMEOUT) == false)
+/**
+ * @brief Like pollQuery(), but tells the outcome by its return value instead of errno.
+ * 
+ * @return The status of this call, IN_PROGRESS while the reply is still awaited.  On ESP32 it
+ * is BUSY (EALREADY) while another task holds the client for an exchange.  The query stays
+ * pending then, just poll again.
+ */
+NTPStatus NTPClient::tryPollQuery(ntp_sample *sample)
+{
+    if (lock_flight(false) == false)
     {
-        // Error code has been set.
-        return false;
+        // Another task is in the middle of an exchange.
+        return NTPStatus::fromErrno(EALREADY);
     }
+    NTPStatus status = poll_query(sample);
+    unlock_flight();
+    return status;
+}
 
-    // This is the reply from my server.
-    // Doing this like described in RFC 4330 '4. Message Format' and '5. SNTP Client Operations'.
-    //
-    // The expected answer should be sent from a server.
-    constexpr uint8_t MODE_MASK = 0b00000'111;
-    constexpr uint8_t MODE_SERVER = 0b00000'100;
-    if ((packet->li_vn_mode & MODE_MASK) != MODE_SERVER)
+/**
+ * @brief Abandons a query started by startQuery().  A late reply will be discarded.
+ */
+void NTPClient::cancelQuery()
+{
+    lock_flight(true);
+    cancel_query();
+    unlock_flight();
+}
+
+/**
+ * @brief Tells whether a query started by startQuery() is waiting for its reply.
+ */
+bool NTPClient::queryPending() const
+{
+    return _query_pending;
+}
+
+/**
+ * @brief The outcome of the last successful call of time() or query().
+ * 
+ * @param[out] sample Receives the sample.
+ * @return true if a sample is available, false if there was no successful exchange yet.
+ */
+bool NTPClient::lastSample(ntp_sample *sample) const
+{
+    if (sample == nullptr)
     {
-        // Operation not supported.
-        errno = EOPNOTSUPP;
+        // Invalid argument.
+        errno = EINVAL;
         return false;
     }
-    // The answer protocol version must be identical to the protocol version we used before.
-    constexpr uint8_t PROTOCOL_MASK = 0b00'111'000;
-    if ((packet->li_vn_mode & PROTOCOL_MASK) != NTP_VERSION_4)
+    if (!_has_sample)
     {
-        // Protocol not supported.
-        errno = EPROTONOSUPPORT;
+        // No data available.
+        errno = ENODATA;
         return false;
     }
-    // There are no valid data if the server clock is not synchronized.
-    constexpr uint8_t LEAP_MASK = 0b11'000000;
-    constexpr uint8_t LEAP_ALARM_CONDITION = 0b11'000000;
-    if ((packet->li_vn_mode & LEAP_MASK) == LEAP_ALARM_CONDITION)
+    *sample = _last_sample;
+    return true;
+}
+
+/**
+ * @brief Header fields a server relaying our time would have to announce.
+ * 
+ * @param[out] packet Receives li_vn_mode, stratum, precision, rootdelay, rootdisp, refid and
+ * reftime of a server mode reply.  The timestamps org, rec and xmt are set to zero.
+ * @return true if the header could be derived, false if there was no successful exchange yet.
+ * 
+ * When this client is used as the upstream of a local server, the server is one stratum below
+ * ours, its reference id is the IPv4 address of our server and root delay and dispersion accumulate
+ * as described in RFC 5905, 11.2 Clock Select Algorithm.  The dispersion also grows with PHI since
+ * the last sample was taken.
+ */
+bool NTPClient::referenceHeader(NTPMessageTransport::ntp_packet *packet) const
+{
+    if (packet == nullptr)
+    {
+        // Invalid argument.
+        errno = EINVAL;
+        return false;
+    }
+    if (!_has_sample)
     {
         // No data available.
         errno = ENODATA;
         return false;
     }
-    // Evaluate stratum ranges
-    if (packet->stratum > 15)
+    double age = (millis() - _last_sample.sync_millis) / 1e3;
+    NTPDuration rootdelay = NTPDuration::fromSeconds(_last_sample.rootdelay + _last_sample.delay);
+    NTPDuration rootdisp = NTPDuration::fromSeconds(_last_sample.rootdisp + ldexp(1.0, PRECISION) + PHI * age);
+    NTPTimestamp reftime = NTPTimestamp::fromUnix(std::chrono::nanoseconds((int64_t)(_last_sample.unix_time * 1e9)));
+
+    memset(packet, 0, sizeof(NTPMessageTransport::ntp_packet));
+    packet->li_vn_mode = (uint8_t)(_last_sample.leap << 6) | NTPEngine::NTP_VERSION_4 | NTPEngine::MODE_SERVER;
+    packet->stratum = (_last_sample.stratum + 1 < MAXSTRAT) ? _last_sample.stratum + 1 : MAXSTRAT;
+    packet->precision = PRECISION;
+    packet->rootdelay = NTPShort::fromDuration(rootdelay).encode();
+    packet->rootdisp = NTPShort::fromDuration(rootdisp).encode();
+    packet->refid = _last_sample.server;
+    packet->reftime = reftime.encode();
+    return true;
+}
+
+/**
+ * @brief The time base disciplined by the samples of this client.
+ * 
+ * Bind ntp_clock to it for std::chrono access to the synchronized time.
+ */
+const NTPTimeBase &NTPClient::timeBase() const
+{
+    return _time_base;
+}
+
+/**
+ * @brief Tells how well this client is synchronized.
+ * 
+ * Every query reports its outcome to the monitor.  Tell it the poll interval you use, so it
+ * knows when samples are missing.
+ */
+NTPSyncMonitor &NTPClient::syncMonitor()
+{
+    return _monitor;
+}
+
+const NTPSyncMonitor &NTPClient::syncMonitor() const
+{
+    return _monitor;
+}
+
+/**
+ * @brief Counters and gauges of this client for monitoring.
+ */
+const NTPClientMetrics &NTPClient::metrics() const
+{
+    return _metrics;
+}
+
+/**
+ * @brief Error reporting
+ * 
+ * @param error if nullptr the message will be printed on serial; if "String *" the message will be copied to the string.
+ */
+void NTPClient::lastErrorString(String *error)
+{
+    String error_str(strerror(errno));
+
+    if (error == nullptr)
     {
-        // Stratum values from 16-255 are reserved and must not be handled.
-        // Protocol family not supported.
-        errno = EPFNOSUPPORT;
-        return false;
+        Serial.print(F("\n"));
+        Serial.print(F("Last error: "));
+        Serial.println(error_str);
     }
-    if (packet->stratum == 0)
+    else
     {
-        // Q.v. "RFC 4330, 6. SNTP Server Operations": "clients should discard the server message".
-        // Print "kiss-o'-death message"
-        NTPMessageTransport::printKissCode((const char *)packet->refid);
-        // Resource temporarily unavailable.
-        errno = EAGAIN;
-        return false;
+        *error = error_str;
     }
-    // Check timestamps.  The Originate Timestamp from the server should
-    // be a copy of the old Transmit Timestamp from the client.
-    if (xmt_bak != packet->org)
+}
+
+/**
+ * @brief Interchange of timestamps T1, T2, T3 and T4 like in "Basic Symmetric Mode" of RFC 5905.
+ * 
+ * @param[in,out] packet The packet to be sent to the server which will be replaced by the packet received by the server.
+ * @return The status of the exchange.
+ * 
+ * Q.v. https://www.eecis.udel.edu/~mills/onwire.html
+ * 
+ */
+NTPStatus NTPClient::on_wire_exchange(NTPMessageTransport::ntp_packet *packet)
+{
+    if (packet == nullptr)
     {
-        // Time stamps do not match.  Bad message.
-        errno = EBADMSG;
-        return false;
+        // Invalid argument.
+        return NTPStatus::fromErrno(EINVAL);
     }
-    return true;
+    NTPMessageTransport::tstamp64_t xmt_bak = packet->xmt;
+    build_request(packet);
+
+    // Doing exchange with the NTP server.
+    NTPStatus status = _ntp->exchange(packet, TIMEOUT);
+    if (!status)
+        return status;
+    return check_reply(*packet, xmt_bak);
+}
+
+/**
+ * @brief Transmit Timestamp T1 for the next request.
+ */
+NTPMessageTransport::tstamp64_t NTPClient::transmit_timestamp() const
+{
+    // NTP era 0 starts at 1. Jan .1900Z00:00.  If system time was given we can set the clock to an interim
+    // time.  This is a good idea, because it creates our UDP packets with non constant timestamps.  So the
+    // values Transmit Timestamp and Originate Timestamp can be distinguished from old packets arriving late.
+    // Not least this enables the "suggested check 3." as demanded in RFC 4330 "5. SNTP Client Operations".
+    // Once we have been synchronized the time base is the best guess, so the offsets stay small.
+    if (_time_base.valid())
+        return _time_base.now().encode();
+    // The local counter is added, so no two requests get the same interim time.
+    return (NTPTimeBase::INTERIM_EPOCH + NTPDuration::fromMicros(NTPTimeBase::localMicros())).encode();
+}
+
+/**
+ * @brief Turns the packet into a client request keeping its Transmit Timestamp.
+ */
+void NTPClient::build_request(NTPMessageTransport::ntp_packet *packet)
+{
+    // I am a client.  This is my request to my server.  The engine writes it, keeping T1.
+    NTPEngine::ntp_request request;
+    NTPEngine::buildRequest(NTPTimestamp::decode(packet->xmt), reinterpret_cast<uint8_t *>(packet), sizeof(*packet), &request);
+}
+
+/**
+ * @brief Checks the reply of the server.
+ * 
+ * @param packet The reply.
+ * @param xmt The Transmit Timestamp of the request.
+ * @return OK if all is fine, else why the reply must be discarded.
+ */
+NTPStatus NTPClient::check_reply(const NTPMessageTransport::ntp_packet &packet, NTPMessageTransport::tstamp64_t xmt)
+{
+    // This is the reply from my server.  The engine checks it like RFC 4330 '5. SNTP Client
+    // Operations' demands it.
+    NTPEngine::ntp_request request = {xmt};
+    NTPEngine::ntp_result result;
+    if (NTPEngine::checkReply(request, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet), &result) == false)
+    {
+        if (result.error == EAGAIN)
+        {
+            // Print "kiss-o'-death message".
+            NTPMessageTransport::printKissCode(result.kiss_code);
+            _metrics.kissReceived(result.kiss_code);
+            return NTPStatus::kissOfDeath(result.kiss_code);
+        }
+        return NTPStatus::fromErrno(result.error);
+    }
+    return NTPStatus();
+}
+
+/**
+ * @brief Reports a failed query to the monitor and the metrics.
+ */
+void NTPClient::query_failed(const NTPStatus &status)
+{
+    _metrics.queryFailed(status.error());
+    _monitor.queryFailed();
+}
+
+/**
+ * @brief Computes offset and delay from a checked reply and keeps them as the last sample.
+ * 
+ * @param packet The reply.
+ * @param t1_wire The Transmit Timestamp of the request.
+ * @return OK, or FILTERED (ERANGE) if the root distance exceeds NTPSyncMonitor::MAXDIST.  Such a
+ * sample is dropped before it can adjust the time base.
+ */
+NTPStatus NTPClient::take_sample(const NTPMessageTransport::ntp_packet &packet, NTPMessageTransport::tstamp64_t t1_wire)
+{
+    // T4 is the final arrive time at the client in relation to T1.  It will be deviated from the
+    // values given by our system internal microseconds clock.  The engine does the On-Wire algorithm.
+    NTPEngine::ntp_request request = {t1_wire};
+    NTPEngine::ntp_result result;
+    NTPTimestamp t4 = NTPTimestamp::decode(t1_wire) + NTPDuration::fromMicros(_ntp->rxMicros() - _ntp->txMicros());
+    NTPEngine::takeSample(request, reinterpret_cast<const uint8_t *>(&packet), t4, &result);
+    NTPDuration offset = result.offset;
+    NTPDuration delay = result.delay;
+
+    // Root distance like RFC 5905 A.5.5.2 is the error bound of the sample.  A server that far
+    // away is no help, its sample must not steer the clock.
+    float distance = NTPSyncMonitor::rootDistance((float)delay.toSeconds(), (float)result.rootdelay.toSeconds(),
+                                                  (float)result.rootdisp.toSeconds());
+    if (distance > NTPSyncMonitor::MAXDIST)
+    {
+        NTPStatus status = NTPStatus::fromErrno(ERANGE);
+        query_failed(status);
+        return status;
+    }
+
+    // Keep the sample for the caller and for serving time derived from it.  The synchronized time
+    // is T4 corrected by the offset plus what has elapsed since the reply arrived.
+    unsigned long sync_millis = millis();
+    unsigned long since_rx_us = micros() - _ntp->rxMicros();
+    int64_t local_us = NTPTimeBase::localMicros() - (int64_t)since_rx_us;
+    NTPDuration elapsed = NTPDuration::fromMicros(since_rx_us);
+    _last_sample.offset = offset.toSeconds();
+    _last_sample.delay = delay.toSeconds();
+    _last_sample.leap = result.leap;
+    _last_sample.stratum = result.stratum;
+    _last_sample.precision = result.precision;
+    _last_sample.refid = result.refid;
+    _last_sample.rootdelay = result.rootdelay.toSeconds();
+    _last_sample.rootdisp = result.rootdisp.toSeconds();
+    _last_sample.server = (uint32_t)_ntp->serverAddress();
+    _last_sample.unix_time = (t4 + offset + elapsed).toUnix().count() / 1e9;
+    _last_sample.sync_millis = sync_millis;
+    _last_sample.local_us = local_us;
+    _has_sample = true;
+    _time_base.update(t4 + offset, local_us, distance);
+    _metrics.sampleTaken((float)_last_sample.offset, (float)_last_sample.delay, _ntp->rxMicros() - _ntp->txMicros());
+    _monitor.sampleReceived((float)_last_sample.delay, (float)_last_sample.rootdelay, (float)_last_sample.rootdisp, sync_millis);
+    return NTPStatus();
 }
@@ -11,32 +11,129 @@
  */
 #pragma once
 
+#include "ClientMetrics.h"
 #include "MessageTransport.h"
+#include "NTPEngine.h"
+#include "NTPClock.h"
+#include "NTPStatus.h"
+#include "SyncMonitor.h"
 #include <WString.h>
 #include <cstdbool>
 #include <ctime>
+#if defined(ESP32)
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
 
 /**
  * @brief NTP client stuff using the On-Wire protocol to calculate the NTP time.
  * 
  * This is the class you need when using the SNTPv4 library.
  * 
+ * On ESP32 the queries may be made from several tasks.  query() and time() wait for an exchange
+ * in flight and share its outcome, a pending query of startQuery() included.  startQuery(),
+ * pollQuery() and their try variants do not wait, they fail with EALREADY while another task
+ * holds the client.  A pending query stays pending then.  cancelQuery() waits.  Set up the server and the transport before the tasks
+ * share the client.
+ * 
  * \sa NTPMessageTransport
  */
 class NTPClient
 {
 public:
+    /**
+     * @brief Outcome of a successful exchange with the server.
+     * 
+     * Besides offset and delay it keeps what the server told about its own synchronization,
+     * q.v. RFC 5905, 7.3 Packet Header Variables.  All durations are given in seconds.
+     */
+    struct ntp_sample
+    {
+        double offset;             ///< clock offset of the server against the local clock
+        double delay;              ///< round-trip delay of the exchange
+        uint8_t leap;              ///< leap indicator of the server (0..3)
+        uint8_t stratum;           ///< stratum of the server
+        int8_t precision;          ///< precision of the server clock as log2 seconds
+        uint32_t refid;            ///< reference id of the server as received (network byte order)
+        double rootdelay;          ///< round-trip delay of the server to its primary source
+        double rootdisp;           ///< dispersion of the server to its primary source
+        uint32_t server;           ///< IPv4 address the sample has been taken from (network byte order)
+        double unix_time;          ///< synchronized time of the sample in Unix format
+        unsigned long sync_millis; ///< millis() when the sample has been taken
+        int64_t local_us;          ///< NTPTimeBase::localMicros() when the reply arrived
+    };
+
+    static constexpr unsigned long TIMEOUT = 1024UL; ///< Milliseconds to wait for a reply.
+
+    NTPClient();
+    explicit NTPClient(NTPMessageTransport &transport);
+    ~NTPClient();
+    NTPClient(const NTPClient &) = delete;
+    NTPClient &operator=(const NTPClient &) = delete;
+
     void begin(const char *ntp_server_name);
     String serverName() const;
     void setServerName(const char *ntp_server_name);
+    NTPMessageTransport &transport();
     time_t time(time_t *tloc = nullptr);
+    bool query(ntp_sample *sample = nullptr);
+    bool startQuery(unsigned long timeout = TIMEOUT);
+    bool pollQuery(ntp_sample *sample = nullptr);
+    NTPStatus tryTime(time_t *tloc = nullptr);
+    NTPStatus tryQuery(ntp_sample *sample = nullptr);
+    NTPStatus tryStartQuery(unsigned long timeout = TIMEOUT);
+    NTPStatus tryPollQuery(ntp_sample *sample = nullptr);
+    void cancelQuery();
+    bool queryPending() const;
+    bool lastSample(ntp_sample *sample) const;
+    bool referenceHeader(NTPMessageTransport::ntp_packet *packet) const;
+    const NTPTimeBase &timeBase() const;
+    NTPSyncMonitor &syncMonitor();
+    const NTPSyncMonitor &syncMonitor() const;
+    const NTPClientMetrics &metrics() const;
     static void lastErrorString(String *error = nullptr);
 
 protected:
     static constexpr char DEFAULT_NTP_SERVER[] = "europe.pool.ntp.org";
-    static constexpr time_t ERA_OFFSET0_1_JAN_1970 = 2208988800LL;
-    bool on_wire_exchange(NTPMessageTransport::ntp_packet *packet);
+    // Taken from the RFC 5905 reference implementation 'A.1.1.'
+    static constexpr double PHI = 15e-6;       ///< frequency tolerance (15 ppm)
+    static constexpr int8_t PRECISION = -10;   ///< local precision (log2 s), limited by the 1 ms receive polling
+    static constexpr uint8_t MAXSTRAT = 16;    ///< maximum stratum number (unsynchronized)
+    NTPStatus on_wire_exchange(NTPMessageTransport::ntp_packet *packet);
+    NTPMessageTransport::tstamp64_t transmit_timestamp() const;
+    void build_request(NTPMessageTransport::ntp_packet *packet);
+    NTPStatus check_reply(const NTPMessageTransport::ntp_packet &packet, NTPMessageTransport::tstamp64_t xmt);
+    void query_failed(const NTPStatus &status);
+    NTPStatus exchange_sample(ntp_sample *sample);
+    NTPStatus start_query(unsigned long timeout);
+    NTPStatus poll_query(ntp_sample *sample);
+    void cancel_query();
+    void finish_flight(const NTPStatus &status);
+    bool lock_flight(bool wait);
+    void unlock_flight();
+    NTPStatus take_sample(const NTPMessageTransport::ntp_packet &packet, NTPMessageTransport::tstamp64_t t1);
 
 private:
-    NTPMessageTransport _ntp;
+    NTPMessageTransport _own_ntp; ///< Transport used unless another one has been given.
+    NTPMessageTransport *_ntp;
+    ntp_sample _last_sample;
+    bool _has_sample = false;
+    NTPTimeBase _time_base;
+    NTPSyncMonitor _monitor;
+    NTPClientMetrics _metrics;
+    // State of the query started by startQuery().
+    NTPMessageTransport::ntp_packet _query_packet;
+    NTPMessageTransport::tstamp64_t _query_t1 = 0;
+    unsigned long _query_start_millis = 0;
+    unsigned long _query_timeout = 0;
+    bool _query_pending = false;
+#if defined(ESP32)
+    // Single flight for concurrent tasks, q.v. tryQuery().
+    SemaphoreHandle_t _flight_lock;            ///< Held by the task using the transport or taking a sample.
+    std::atomic<uint32_t> _flight_generation{0}; ///< Counts the finished exchanges.
+    NTPStatus _flight_status;                  ///< Outcome of the last exchange for those who waited.
+    TaskHandle_t _query_task = nullptr;        ///< Task that has started the pending query.
+#endif
 };